@@ -0,0 +1,216 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 32
+#define ARENA_LARGE_BLOCK (1 << 20)
+#define ARENA_FIRST_CHUNK (64 << 10)
+#define ARENA_MAX_CHUNK (4 << 20)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaChunk {
+    ArenaChunk* next;
+    size_t size;
+};
+
+struct ArenaLarge {
+    ArenaLarge* prev;
+    ArenaLarge* next;
+    size_t size;
+};
+
+#define CHUNK_HEADER ARENA_ROUND(sizeof(ArenaChunk))
+#define LARGE_HEADER ARENA_ROUND(sizeof(ArenaLarge))
+
+// Rounds size up to its class, 2^k + m * 2^k / 4 for m in 1..4, so a
+// buffer is never more than a quarter bigger than asked for
+static size_t size_class(size_t size, int* index) {
+    if (size <= ARENA_MIN_BLOCK) {
+        *index = 0;
+        return ARENA_MIN_BLOCK;
+    }
+
+    int k = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    size_t base = (size_t)1 << k;
+    size_t step = base / 4;
+    size_t m = (size - base + step - 1) / step;
+    *index = (k - 5) * 4 + (int)m;
+    return base + m * step;
+}
+
+void arena_init(Arena* arena) {
+    memset(arena, 0, sizeof(Arena));
+    arena->next_chunk_size = ARENA_FIRST_CHUNK;
+}
+
+void arena_free(Arena* arena) {
+    if (!arena) return;
+
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    ArenaLarge* large = arena->large;
+    while (large) {
+        ArenaLarge* next = large->next;
+        free(large);
+        large = next;
+    }
+    arena_init(arena);
+}
+
+// A chunk of its own for anything big next to the chunks being filled,
+// so it doesn't cut the current one short
+static void* dedicated_chunk(Arena* arena, size_t size) {
+    ArenaChunk* chunk = malloc(CHUNK_HEADER + size);
+    if (!chunk) return NULL;
+    chunk->size = CHUNK_HEADER + size;
+    if (arena->chunks) {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    } else {
+        chunk->next = NULL;
+        arena->chunks = chunk;
+    }
+    arena->reserved += chunk->size;
+    return (char*)chunk + CHUNK_HEADER;
+}
+
+// Bump allocation, whatever is left of a full chunk is given up
+static void* bump(Arena* arena, size_t size) {
+    size = ARENA_ROUND(size);
+    if (size > arena->next_chunk_size / 4) return dedicated_chunk(arena, size);
+
+    if ((size_t)(arena->limit - arena->cursor) < size) {
+        size_t chunk_size = arena->next_chunk_size;
+        ArenaChunk* chunk = malloc(chunk_size);
+        if (!chunk) return NULL;
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->cursor = (char*)chunk + CHUNK_HEADER;
+        arena->limit = (char*)chunk + chunk_size;
+        arena->reserved += chunk_size;
+        if (arena->next_chunk_size < ARENA_MAX_CHUNK) arena->next_chunk_size *= 2;
+    }
+
+    void* p = arena->cursor;
+    arena->cursor += size;
+    return p;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    if (!arena) return malloc(size);
+    arena->allocations++;
+    return bump(arena, size);
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+static void* large_alloc(Arena* arena, size_t size) {
+    ArenaLarge* large = malloc(LARGE_HEADER + size);
+    if (!large) return NULL;
+    large->prev = NULL;
+    large->next = arena->large;
+    large->size = size;
+    if (arena->large) arena->large->prev = large;
+    arena->large = large;
+    arena->reserved += LARGE_HEADER + size;
+    return (char*)large + LARGE_HEADER;
+}
+
+static ArenaLarge* large_header(void* block) {
+    return (ArenaLarge*)((char*)block - LARGE_HEADER);
+}
+
+void* arena_block_alloc(Arena* arena, size_t* size) {
+    if (!arena) return malloc(*size ? *size : 1);
+    arena->allocations++;
+    if (*size > ARENA_LARGE_BLOCK) return large_alloc(arena, *size);
+
+    int index;
+    *size = size_class(*size, &index);
+    void* block = arena->free_blocks[index];
+    if (block) {
+        arena->free_blocks[index] = *(void**)block;
+        return block;
+    }
+    return bump(arena, *size);
+}
+
+void arena_block_release(Arena* arena, void* block, size_t size) {
+    if (!block) return;
+    if (!arena) {
+        free(block);
+        return;
+    }
+
+    if (size > ARENA_LARGE_BLOCK) {
+        ArenaLarge* large = large_header(block);
+        if (large->prev) large->prev->next = large->next;
+        else arena->large = large->next;
+        if (large->next) large->next->prev = large->prev;
+        arena->reserved -= LARGE_HEADER + large->size;
+        free(large);
+        return;
+    }
+
+    int index;
+    size_class(size, &index);
+    *(void**)block = arena->free_blocks[index];
+    arena->free_blocks[index] = block;
+}
+
+void* arena_block_realloc(Arena* arena, void* block, size_t old_size, size_t* size) {
+    if (!arena) return realloc(block, *size ? *size : 1);
+    if (!block) return arena_block_alloc(arena, size);
+
+    // Large to large keeps realloc's chance of growing in place
+    if (old_size > ARENA_LARGE_BLOCK && *size > ARENA_LARGE_BLOCK) {
+        ArenaLarge* old = large_header(block);
+        ArenaLarge* prev = old->prev;
+        ArenaLarge* next = old->next;
+        size_t old_bytes = LARGE_HEADER + old->size;
+
+        ArenaLarge* large = realloc(old, LARGE_HEADER + *size);
+        if (!large) return NULL;
+        if (prev) prev->next = large;
+        else arena->large = large;
+        if (next) next->prev = large;
+        large->size = *size;
+        arena->reserved += LARGE_HEADER + *size - old_bytes;
+        arena->allocations++;
+        return (char*)large + LARGE_HEADER;
+    }
+
+    // Still fits the class it came from
+    if (old_size <= ARENA_LARGE_BLOCK && *size <= ARENA_LARGE_BLOCK) {
+        int old_index, index;
+        size_class(old_size, &old_index);
+        size_t class_size = size_class(*size, &index);
+        if (index == old_index) {
+            *size = class_size;
+            return block;
+        }
+    }
+
+    void* new_block = arena_block_alloc(arena, size);
+    if (!new_block) return NULL;
+    memcpy(new_block, block, old_size < *size ? old_size : *size);
+    arena_block_release(arena, block, old_size);
+    return new_block;
+}
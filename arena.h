@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_CLASS_COUNT 61
+
+typedef struct ArenaChunk ArenaChunk;
+typedef struct ArenaLarge ArenaLarge;
+
+// Region allocator for everything that lives as long as a DataLog. Small
+// objects (names, units, structs) are bump allocated out of chunks and only
+// go away with the whole arena. Growable buffers are handed out in size
+// classes, four per power of two, and a released buffer goes on its class's
+// free list for the next one that grows through that size. Buffers above a
+// megabyte are separate heap blocks given back as soon as they are released,
+// so a big column that was resampled doesn't stay resident.
+//
+// Freeing the arena releases everything in one go. A NULL arena means the
+// plain heap for objects that live on their own. An arena belongs to one
+// thread at a time.
+typedef struct {
+    ArenaChunk* chunks;
+    char* cursor;
+    char* limit;
+    size_t next_chunk_size;
+    void* free_blocks[ARENA_CLASS_COUNT];
+    ArenaLarge* large;
+    size_t reserved;        // Bytes taken from the heap
+    uint64_t allocations;   // Requests served, from free lists or not
+} Arena;
+
+void arena_init(Arena* arena);
+void arena_free(Arena* arena);
+
+// Memory that is only given back with the arena
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strdup(Arena* arena, const char* str);
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+
+// Buffers that can be grown and released. size is rounded up to the size
+// actually handed out, callers can use all of it.
+void* arena_block_alloc(Arena* arena, size_t* size);
+void* arena_block_realloc(Arena* arena, void* block, size_t old_size, size_t* size);
+void arena_block_release(Arena* arena, void* block, size_t size);
+
+#endif
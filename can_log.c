@@ -0,0 +1,303 @@
+#include "can_log.h"
+#include <pthread.h>
+
+// Standard IDs index the frame table directly, extended ones go through a
+// small open addressing table keyed on the ID with DBC_EXTENDED_FLAG set,
+// so an extended frame never matches a standard message of the same number
+#define DIRECT_FRAME_IDS 2048
+#define CAN_MAX_DATA 8
+#define CAN_DECIMALS 3
+#define INITIAL_FRAME_CAPACITY 1024
+#define CAN_BATCH_FRAMES 256
+
+// Decoding state of one DBC message. Frames are queued and decoded a batch
+// at a time, one signal over the whole batch before the next.
+typedef struct {
+    const DbcMessage* message;
+    TimeAxis* time;
+    Channel** channels;    // One per DBC signal, NULL until first decoded
+    int selector;          // Index of the multiplexer signal or -1
+    int pending_channels;  // Signals without a channel yet
+    uint64_t* frames;      // Queued frames, CAN_BATCH_FRAMES of them
+    size_t frame_count;
+} FrameDecoder;
+
+typedef struct {
+    uint32_t key;
+    FrameDecoder* decoder; // NULL marks an empty slot
+} FrameSlot;
+
+typedef struct {
+    FrameDecoder* decoders;
+    int decoder_count;
+    FrameDecoder* direct[DIRECT_FRAME_IDS];
+    FrameSlot* slots;
+    size_t slot_mask;
+} FrameTable;
+
+static const uint8_t HEX_INVALID = 0xff;
+static uint8_t hex_values[256];
+static pthread_once_t hex_values_once = PTHREAD_ONCE_INIT;
+
+static void init_hex_values(void) {
+    memset(hex_values, HEX_INVALID, sizeof(hex_values));
+    for (int i = 0; i < 10; i++) hex_values['0' + i] = (uint8_t)i;
+    for (int i = 0; i < 6; i++) {
+        hex_values['a' + i] = (uint8_t)(10 + i);
+        hex_values['A' + i] = (uint8_t)(10 + i);
+    }
+}
+
+static uint32_t frame_key(uint32_t id, int extended) {
+    return extended ? id | DBC_EXTENDED_FLAG : id;
+}
+
+static FrameDecoder* frame_table_find(const FrameTable* table, uint32_t key) {
+    if (key < DIRECT_FRAME_IDS) return table->direct[key];
+    if (!table->slots) return NULL;
+
+    size_t i = (key * 2654435761u) & table->slot_mask;
+    while (table->slots[i].decoder) {
+        if (table->slots[i].key == key) return table->slots[i].decoder;
+        i = (i + 1) & table->slot_mask;
+    }
+    return NULL;
+}
+
+static int frame_table_init(FrameTable* table, const Dbc* dbc) {
+    memset(table, 0, sizeof(FrameTable));
+    table->decoders = calloc(dbc->message_count ? dbc->message_count : 1, sizeof(FrameDecoder));
+    if (!table->decoders) return -1;
+
+    size_t slot_count = 16;
+    while (slot_count < (size_t)dbc->message_count * 2) slot_count *= 2;
+    table->slots = calloc(slot_count, sizeof(FrameSlot));
+    if (!table->slots) return -1;
+    table->slot_mask = slot_count - 1;
+
+    for (int m = 0; m < dbc->message_count; m++) {
+        const DbcMessage* message = &dbc->messages[m];
+        uint32_t key = frame_key(message->id, message->extended);
+
+        // The first definition of an ID wins, like a lookup by ID would
+        if (frame_table_find(table, key)) continue;
+
+        FrameDecoder* decoder = &table->decoders[table->decoder_count++];
+        decoder->message = message;
+        decoder->selector = -1;
+        for (int s = 0; s < message->signal_count; s++) {
+            if (message->signals[s].mux_role == DBC_MUX_SELECTOR) decoder->selector = s;
+        }
+        decoder->pending_channels = message->signal_count;
+        decoder->channels = calloc(message->signal_count ? message->signal_count : 1, sizeof(Channel*));
+        if (!decoder->channels) return -1;
+
+        if (key < DIRECT_FRAME_IDS) {
+            table->direct[key] = decoder;
+        } else {
+            size_t i = (key * 2654435761u) & table->slot_mask;
+            while (table->slots[i].decoder) i = (i + 1) & table->slot_mask;
+            table->slots[i].key = key;
+            table->slots[i].decoder = decoder;
+        }
+    }
+    return 0;
+}
+
+static void frame_table_free(FrameTable* table) {
+    for (int i = 0; i < table->decoder_count; i++) {
+        free(table->decoders[i].channels);
+        free(table->decoders[i].frames);
+        time_axis_release(table->decoders[i].time);
+    }
+    free(table->decoders);
+    free(table->slots);
+}
+
+// Seconds and fractional digits as an integer count of microseconds, so the
+// double that comes out is the correctly rounded decimal timestamp
+static const char* parse_timestamp(const char* p, const char* end, double* timestamp) {
+    if (p >= end || *p != '(') return NULL;
+    p++;
+
+    uint64_t seconds = 0;
+    const char* digits = p;
+    while (p < end && *p >= '0' && *p <= '9') seconds = seconds * 10 + (uint64_t)(*p++ - '0');
+    if (p == digits || p >= end) return NULL;
+
+    uint64_t micros = 0;
+    int fraction_digits = 0;
+    if (*p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (fraction_digits < 6) {
+                micros = micros * 10 + (uint64_t)(*p - '0');
+                fraction_digits++;
+            }
+            p++;
+        }
+    }
+    while (fraction_digits++ < 6) micros *= 10;
+    if (p >= end || *p != ')') return NULL;
+
+    *timestamp = (double)(seconds * 1000000 + micros) / 1e6;
+    return p + 1;
+}
+
+// "ID#DATA" with a hex ID and up to 8 hex byte pairs, FD frames ("ID##")
+// and remote frames ("ID#R") are rejected. candump writes standard IDs with
+// 3 digits and extended ones with 8, an ID that doesn't fit in 11 bits is
+// extended whatever its width.
+static int parse_frame(const char* p, const char* end, uint32_t* id, int* extended,
+                       uint8_t* data, int* length) {
+    uint32_t value = 0;
+    const char* digits = p;
+    while (p < end && hex_values[(uint8_t)*p] != HEX_INVALID) {
+        value = (value << 4) | hex_values[(uint8_t)*p++];
+    }
+    size_t id_digits = (size_t)(p - digits);
+    if (id_digits == 0 || id_digits > 8 || p >= end || *p != '#') return -1;
+    p++;
+
+    int n = 0;
+    while (end - p >= 2 && n < CAN_MAX_DATA) {
+        uint8_t hi = hex_values[(uint8_t)p[0]];
+        uint8_t lo = hex_values[(uint8_t)p[1]];
+        if (hi == HEX_INVALID || lo == HEX_INVALID) break;
+        data[n++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+    if (p < end && hex_values[(uint8_t)*p] != HEX_INVALID) return -1;
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r') return -1;
+
+    *id = value & DBC_ID_MASK;
+    *extended = id_digits > 3 || *id >= DIRECT_FRAME_IDS;
+    *length = n;
+    return 0;
+}
+
+// Channels are created in the order signals first decode, as data_log.py
+// does, so multiplexed signals are checked frame by frame until every
+// signal of the message has shown up
+static int create_channels(DataLog* log, FrameDecoder* decoder, uint64_t frame) {
+    const DbcMessage* message = decoder->message;
+    uint64_t selected = decoder->selector >= 0 ?
+        dbc_plan_raw(&message->signals[decoder->selector].plan, frame) : 0;
+
+    for (int s = 0; s < message->signal_count; s++) {
+        const DbcSignal* signal = &message->signals[s];
+        if (decoder->channels[s]) continue;
+        if (signal->mux_role == DBC_MUX_MULTIPLEXED && (uint64_t)signal->mux_value != selected) continue;
+
+        Channel* channel = channel_create_on_axis(signal->name, signal->unit, CAN_DECIMALS, decoder->time);
+        if (!channel) return -1;
+        if (datalog_append_channel(log, channel) != 0) {
+            channel_destroy(channel);
+            return -1;
+        }
+        decoder->channels[s] = channel;
+        decoder->pending_channels--;
+    }
+    return 0;
+}
+
+static int flush_frames(FrameDecoder* decoder) {
+    const DbcMessage* message = decoder->message;
+    size_t count = decoder->frame_count;
+    double values[CAN_BATCH_FRAMES];
+    uint64_t selected[CAN_BATCH_FRAMES];
+
+    if (count == 0) return 0;
+    size_t first = decoder->time->count - count;
+    if (decoder->selector >= 0) {
+        dbc_plan_extract(&message->signals[decoder->selector].plan, decoder->frames, count, selected);
+    }
+
+    for (int s = 0; s < message->signal_count; s++) {
+        const DbcSignal* signal = &message->signals[s];
+        Channel* channel = decoder->channels[s];
+        if (!channel) continue;
+
+        // A multiplexed signal that showed up late is missing before that
+        while (channel->message_count < first) {
+            if (channel_append_missing(channel) != 0) return -1;
+        }
+
+        dbc_plan_decode(&signal->plan, decoder->frames, count, values);
+        if (signal->mux_role != DBC_MUX_MULTIPLEXED) {
+            if (channel_append_values(channel, values, count) != 0) return -1;
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            int result = selected[i] == (uint64_t)signal->mux_value ?
+                channel_append(channel, values[i]) : channel_append_missing(channel);
+            if (result != 0) return -1;
+        }
+    }
+
+    decoder->frame_count = 0;
+    return 0;
+}
+
+static int queue_frame(DataLog* log, FrameDecoder* decoder, double timestamp, uint64_t frame) {
+    if (!decoder->frames) {
+        decoder->time = datalog_create_time_axis(log, INITIAL_FRAME_CAPACITY);
+        decoder->frames = malloc(sizeof(uint64_t) * CAN_BATCH_FRAMES);
+        if (!decoder->time || !decoder->frames) return -1;
+    }
+
+    if (time_axis_append(decoder->time, timestamp) != 0) return -1;
+    decoder->frames[decoder->frame_count++] = frame;
+
+    if (decoder->pending_channels > 0 && create_channels(log, decoder, frame) != 0) return -1;
+    if (decoder->frame_count == CAN_BATCH_FRAMES) return flush_frames(decoder);
+    return 0;
+}
+
+int can_log_decode(DataLog* log, const char* data, size_t size, const Dbc* dbc) {
+    if (!log || !data || !dbc) return -1;
+    pthread_once(&hex_values_once, init_hex_values);
+
+    FrameTable table;
+    if (frame_table_init(&table, dbc) != 0) {
+        frame_table_free(&table);
+        return -1;
+    }
+
+    int result = 0;
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end && result == 0) {
+        const char* newline = memchr(p, '\n', (size_t)(end - p));
+        const char* line_end = newline ? newline : end;
+        const char* line = p;
+        p = newline ? newline + 1 : end;
+
+        // (timestamp) bus frame, lines that don't parse are skipped
+        double timestamp;
+        line = parse_timestamp(line, line_end, &timestamp);
+        if (!line) continue;
+        while (line < line_end && *line == ' ') line++;
+        while (line < line_end && *line != ' ') line++;
+        while (line < line_end && *line == ' ') line++;
+
+        uint32_t id;
+        int extended;
+        int length;
+        uint8_t frame[CAN_MAX_DATA] = {0};
+        if (parse_frame(line, line_end, &id, &extended, frame, &length) != 0) continue;
+
+        FrameDecoder* decoder = frame_table_find(&table, frame_key(id, extended));
+        if (!decoder || length < decoder->message->dlc) continue;
+
+        result = queue_frame(log, decoder, timestamp, dbc_frame_word(frame));
+    }
+
+    for (int i = 0; result == 0 && i < table.decoder_count; i++) {
+        result = flush_frames(&table.decoders[i]);
+    }
+
+    frame_table_free(&table);
+    return result;
+}
@@ -0,0 +1,13 @@
+#ifndef CAN_LOG_H
+#define CAN_LOG_H
+
+#include "data_log.h"
+#include "dbc.h"
+
+// Decodes a candump -l log, lines of "(seconds.micros) bus ID#DATA". Every
+// DBC signal seen in the log becomes a channel, named and with units as in
+// the DBC, in the order signals first show up. The signals of one message
+// share a time axis with a sample per frame of that message.
+int can_log_decode(DataLog* log, const char* data, size_t size, const Dbc* dbc);
+
+#endif
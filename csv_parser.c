@@ -0,0 +1,318 @@
+#include "csv_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define INITIAL_FIELD_CAPACITY 64
+#define CSV_BLOCK_SIZE 64
+#define MAX_NUMBER_LENGTH 64
+#define MAX_FAST_DIGITS 19
+#define MAX_FAST_MANTISSA (1ULL << 53)
+#define MAX_FAST_POW10 22
+
+// Powers of ten that are exactly representable as doubles
+static const double POW10[MAX_FAST_POW10 + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+void csv_row_init(CsvRow* row) {
+    row->fields = NULL;
+    row->count = 0;
+    row->capacity = 0;
+}
+
+void csv_row_free(CsvRow* row) {
+    free(row->fields);
+    csv_row_init(row);
+}
+
+static void set_field(CsvField* field, const char* start, const char* stop) {
+    // Trim whitespace (including the \r of CRLF files) from both ends
+    while (start < stop && is_blank(*start)) start++;
+    while (stop > start && is_blank(stop[-1])) stop--;
+
+    // Drop the quotes around quoted fields, the contents stay in place so
+    // doubled "" escapes inside are left as they are
+    if (stop - start >= 2 && *start == '"' && stop[-1] == '"') {
+        start++;
+        stop--;
+    }
+
+    field->start = start;
+    field->len = (size_t)(stop - start);
+}
+
+static int csv_row_push(CsvRow* row, const char* start, const char* stop) {
+    if (row->count >= row->capacity) {
+        size_t new_capacity = row->capacity ? row->capacity * 2 : INITIAL_FIELD_CAPACITY;
+        CsvField* new_fields = realloc(row->fields, sizeof(CsvField) * new_capacity);
+        if (!new_fields) return -1;
+        row->fields = new_fields;
+        row->capacity = new_capacity;
+    }
+
+    set_field(&row->fields[row->count++], start, stop);
+    return 0;
+}
+
+// Block scanners return a 64 bit mask with one bit per input byte that is a
+// comma, newline or quote. All the per byte work of tokenizing happens here,
+// the row splitter only visits the set bits.
+typedef uint64_t (*BlockMaskFn)(const char* p);
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t block_mask_sse2(const char* p) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i quote = _mm_set1_epi8('"');
+    uint64_t mask = 0;
+
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(
+            _mm_cmpeq_epi8(block, comma),
+            _mm_cmpeq_epi8(block, newline)),
+            _mm_cmpeq_epi8(block, quote));
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(hits) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t block_mask_avx2(const char* p) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i quote = _mm256_set1_epi8('"');
+
+    __m256i lo = _mm256_loadu_si256((const __m256i*)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+    __m256i hits_lo = _mm256_or_si256(_mm256_or_si256(
+        _mm256_cmpeq_epi8(lo, comma),
+        _mm256_cmpeq_epi8(lo, newline)),
+        _mm256_cmpeq_epi8(lo, quote));
+    __m256i hits_hi = _mm256_or_si256(_mm256_or_si256(
+        _mm256_cmpeq_epi8(hi, comma),
+        _mm256_cmpeq_epi8(hi, newline)),
+        _mm256_cmpeq_epi8(hi, quote));
+
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(hits_lo) |
+           ((uint64_t)(uint32_t)_mm256_movemask_epi8(hits_hi) << 32);
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+static uint8x16_t neon_hits(const char* p) {
+    uint8x16_t block = vld1q_u8((const uint8_t*)p);
+    return vorrq_u8(vorrq_u8(
+        vceqq_u8(block, vdupq_n_u8(',')),
+        vceqq_u8(block, vdupq_n_u8('\n'))),
+        vceqq_u8(block, vdupq_n_u8('"')));
+}
+
+static uint64_t block_mask_neon(const char* p) {
+    // NEON has no movemask, weight each lane by its bit and add pairwise
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t a = vandq_u8(neon_hits(p), bits);
+    uint8x16_t b = vandq_u8(neon_hits(p + 16), bits);
+    uint8x16_t c = vandq_u8(neon_hits(p + 32), bits);
+    uint8x16_t d = vandq_u8(neon_hits(p + 48), bits);
+
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(a, b), vpaddq_u8(c, d));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+#else
+static uint64_t block_mask_scalar(const char* p) {
+    uint64_t mask = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++) {
+        char c = p[i];
+        if (c == ',' || c == '\n' || c == '"') mask |= 1ULL << i;
+    }
+    return mask;
+}
+#endif
+
+// Commas and newlines inside double quotes are part of the field, so the
+// quote state is carried from one special character to the next
+static inline const char* scan_row(const char* p, const char* end, CsvRow* row,
+                                   BlockMaskFn block_mask) {
+    const char* field = p;
+    int in_quotes = 0;
+
+    while (end - p >= CSV_BLOCK_SIZE) {
+        uint64_t mask = block_mask(p);
+        while (mask) {
+            const char* c = p + __builtin_ctzll(mask);
+            mask &= mask - 1;
+
+            if (*c == '"') {
+                in_quotes = !in_quotes;
+            } else if (!in_quotes) {
+                if (csv_row_push(row, field, c) != 0) return end;
+                if (*c == '\n') return c + 1;
+                field = c + 1;
+            }
+        }
+        p += CSV_BLOCK_SIZE;
+    }
+
+    // Less than a block left, finish byte at a time
+    for (; p < end; p++) {
+        if (*p == '"') {
+            in_quotes = !in_quotes;
+        } else if (!in_quotes && (*p == ',' || *p == '\n')) {
+            if (csv_row_push(row, field, p) != 0) return end;
+            if (*p == '\n') return p + 1;
+            field = p + 1;
+        }
+    }
+
+    csv_row_push(row, field, end);
+    return end;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static const char* scan_row_avx2(const char* p, const char* end, CsvRow* row) {
+    return scan_row(p, end, row, block_mask_avx2);
+}
+
+static const char* scan_row_sse2(const char* p, const char* end, CsvRow* row) {
+    return scan_row(p, end, row, block_mask_sse2);
+}
+#endif
+
+const char* csv_split_row(const char* p, const char* end, CsvRow* row) {
+    row->count = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_row_avx2(p, end, row);
+    }
+    return scan_row_sse2(p, end, row);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    return scan_row(p, end, row, block_mask_neon);
+#else
+    return scan_row(p, end, row, block_mask_scalar);
+#endif
+}
+
+const char* csv_skip_row(const char* p, const char* end) {
+    const char* newline = memchr(p, '\n', (size_t)(end - p));
+    return newline ? newline + 1 : end;
+}
+
+const char* csv_first_field(const char* p, const char* end, CsvField* field) {
+    const char* next = csv_skip_row(p, end);
+    const char* comma = memchr(p, ',', (size_t)(next - p));
+    set_field(field, p, comma ? comma : next);
+    return next;
+}
+
+static int is_digit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+// Rare forms (long mantissas, huge exponents, inf/nan, hex) go through
+// strtod. The tool never calls setlocale so this runs in the "C" locale.
+static int parse_number_slow(const char* p, size_t len, double* value) {
+    char buffer[MAX_NUMBER_LENGTH];
+    if (len >= MAX_NUMBER_LENGTH) return 0;
+
+    memcpy(buffer, p, len);
+    buffer[len] = '\0';
+
+    char* endptr;
+    double result = strtod(buffer, &endptr);
+    if (endptr == buffer || *endptr != '\0') return 0;
+
+    *value = result;
+    return 1;
+}
+
+int csv_parse_number(const char* p, size_t len, double* value, int* decimals) {
+    const char* s = p;
+    const char* end = p + len;
+    if (s >= end) return 0;
+
+    int negative = 0;
+    if (*s == '-' || *s == '+') {
+        negative = *s == '-';
+        s++;
+    }
+
+    // Integer and fractional digits accumulate into one mantissa
+    uint64_t mantissa = 0;
+    int digit_count = 0;
+    int frac_count = 0;
+    while (s < end && is_digit(*s)) {
+        mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+        digit_count++;
+        s++;
+    }
+    if (s < end && *s == '.') {
+        s++;
+        while (s < end && is_digit(*s)) {
+            mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+            digit_count++;
+            frac_count++;
+            s++;
+        }
+    }
+
+    // Digits past 19 would have overflowed the mantissa above
+    int fast = digit_count > 0 && digit_count <= MAX_FAST_DIGITS;
+
+    int exponent = 0;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+        int exp_negative = 0;
+        if (s < end && (*s == '-' || *s == '+')) {
+            exp_negative = *s == '-';
+            s++;
+        }
+        if (s >= end || !is_digit(*s)) return 0;
+        while (s < end && is_digit(*s)) {
+            if (exponent < 10000) exponent = exponent * 10 + (*s - '0');
+            s++;
+        }
+        if (exp_negative) exponent = -exponent;
+    }
+
+    if (decimals) {
+        int present = frac_count - exponent;
+        *decimals = present > 0 ? present : 0;
+    }
+
+    // Anything left over is either a form only strtod understands or junk
+    if (s != end || digit_count == 0) {
+        if (decimals) *decimals = 0;
+        return parse_number_slow(p, len, value);
+    }
+
+    // Exact mantissa and an exact power of ten means a single correctly
+    // rounded multiply or divide gives the same result as strtod
+    int scale = exponent - frac_count;
+    if (!fast || mantissa > MAX_FAST_MANTISSA || scale < -MAX_FAST_POW10 || scale > MAX_FAST_POW10) {
+        return parse_number_slow(p, len, value);
+    }
+
+    double result = (double)mantissa;
+    if (scale < 0) {
+        result /= POW10[-scale];
+    } else if (scale > 0) {
+        result *= POW10[scale];
+    }
+
+    *value = negative ? -result : result;
+    return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef CSV_PARSER_H
+#define CSV_PARSER_H
+
+#include <stddef.h>
+
+// A single field inside a CSV buffer, pointing straight into the input bytes.
+// Fields are not NUL terminated and have surrounding whitespace trimmed.
+typedef struct {
+    const char* start;
+    size_t len;
+} CsvField;
+
+// Reusable field list for one row, grows as needed but is never shrunk so
+// splitting rows after the first one doesn't allocate
+typedef struct {
+    CsvField* fields;
+    size_t count;
+    size_t capacity;
+} CsvRow;
+
+void csv_row_init(CsvRow* row);
+void csv_row_free(CsvRow* row);
+
+// Splits the line starting at p into row, returns the start of the next line.
+// Scans 64 bytes at a time with SSE2/AVX2 (NEON on arm64) and honours double
+// quoted fields, so commas and newlines inside quotes don't split the row.
+const char* csv_split_row(const char* p, const char* end, CsvRow* row);
+
+// Returns the start of the line after the one starting at p
+const char* csv_skip_row(const char* p, const char* end);
+
+// Extracts only the first field of the line starting at p, for passes that
+// just need the time column. Returns the start of the next line.
+const char* csv_first_field(const char* p, const char* end, CsvField* field);
+
+// Validates and converts a field in one pass, independent of the current
+// locale. Returns 1 when the whole field is a number, 0 otherwise. The count
+// of digits after the decimal point is stored in decimals when non NULL.
+int csv_parse_number(const char* p, size_t len, double* value, int* decimals);
+
+#endif
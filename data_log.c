@@ -1,27 +1,28 @@
 #include "data_log.h"
+#include "csv_parser.h"
+#include "can_log.h"
+#include "dbc_cache.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
 #include <ctype.h>
 
-#define MAX_LINE_LENGTH 1024
-#define MAX_COLUMNS 1000
+#define CSV_MIN_CHUNK_SIZE (1 << 20)
+#define CSV_CHUNKS_PER_THREAD 4
 #define INITIAL_CHANNEL_CAPACITY 500
-
-// Helper function to check if string is numeric
-int is_numeric(const char* str) {
-    if (!str || !*str) return 0;  // Check for NULL or empty string
-    // printf("Debug - Checking if numeric: '%s'\n", str); // Debug
-    char* endptr;
-    strtod(str, &endptr);
-    return *endptr == '\0' || isspace((unsigned char)*endptr);
-}
+#define VALID_WORDS(n) (((n) + 63) / 64)
+#define RESAMPLE_BLOCK_SIZE 4096
 
 DataLog* datalog_create(const char* name) {
     DataLog* log = (DataLog*)malloc(sizeof(DataLog));
     if (!log) return NULL;
     
-    log->name = strdup(name);
-    log->channel_capacity = INITIAL_CHANNEL_CAPACITY;
+    arena_init(&log->arena);
+    size_t size = sizeof(Channel*) * INITIAL_CHANNEL_CAPACITY;
+    log->name = arena_strdup(&log->arena, name);
+    log->channels = (Channel**)arena_block_alloc(&log->arena, &size);
+    log->channel_capacity = size / sizeof(Channel*);
     log->channel_count = 0;
-    log->channels = (Channel**)malloc(sizeof(Channel*) * log->channel_capacity);
+    name_index_init(&log->names);
     
     return log;
 }
@@ -31,129 +32,424 @@ void datalog_clear(DataLog* log) {
         channel_destroy(log->channels[i]);
     }
     log->channel_count = 0;
+    name_index_clear(&log->names);
 }
 
 void datalog_destroy(DataLog* log) {
     if (log) {
-        datalog_clear(log);
-        free(log->channels);
-        free(log->name);
+        // Everything else goes with the arena
+        for (size_t i = 0; i < log->channel_count; i++) {
+            if (log->channels[i]->arena != &log->arena) channel_destroy(log->channels[i]);
+        }
+        name_index_free(&log->names);
+        arena_free(&log->arena);
         free(log);
     }
 }
 
 
-int datalog_from_csv_log(DataLog* log, FILE* f) {
-    if (!f) return -1;
-    
-    char line[MAX_LINE_LENGTH];
-    char* header = NULL;
-    char* units = NULL;
-    
-    // Read header and units lines
-    if (fgets(line, MAX_LINE_LENGTH, f)) {
-        header = strdup(line);
-        // printf("Debug - Header line: %s\n", header);
+// Copies a field into a NUL terminated heap string
+static char* field_strdup(const CsvField* field) {
+    char* str = malloc(field->len + 1);
+    if (!str) return NULL;
+    memcpy(str, field->start, field->len);
+    str[field->len] = '\0';
+    return str;
+}
+
+int datalog_append_channel(DataLog* log, Channel* channel) {
+    if (log->channel_count >= log->channel_capacity) {
+        size_t size = sizeof(Channel*) * log->channel_capacity * 2;
+        Channel** new_channels = arena_block_realloc(&log->arena, log->channels,
+            sizeof(Channel*) * log->channel_capacity, &size);
+        if (!new_channels) return -1;
+        log->channels = new_channels;
+        log->channel_capacity = size / sizeof(Channel*);
     }
-    if (fgets(line, MAX_LINE_LENGTH, f)) {
-        units = strdup(line);
-        // printf("Debug - Units line: %s\n", units);
+
+    if (name_index_insert(&log->names, channel->name, (int)log->channel_count) != 0) return -1;
+    log->channels[log->channel_count++] = channel;
+    return 0;
+}
+
+// A cell that was empty or not numeric
+typedef struct {
+    size_t row;
+    size_t channel;
+} MissingCell;
+
+// A line aligned slice of the data rows. Every chunk writes its rows
+// straight into the shared columns starting at row_offset, sized from a
+// newline count so the columns are allocated once up front.
+typedef struct {
+    const char* start;
+    const char* end;
+    size_t row_offset;
+    size_t row_capacity;
+    size_t row_count;
+    int* decimals;
+    MissingCell* missing;
+    size_t missing_count;
+    size_t missing_capacity;
+    int failed;
+} CsvChunk;
+
+// A CSV column that becomes a channel
+typedef struct {
+    size_t field;          // Index of the values in each row
+    CsvField name;
+    CsvField units;
+} CsvColumn;
+
+typedef struct {
+    DataLog* log;
+    TimeAxis* time;
+    CsvChunk* chunks;
+    size_t chunk_count;
+    const CsvColumn* columns;
+    size_t channel_count;
+} CsvParseJob;
+
+static int csv_chunk_add_missing(CsvChunk* chunk, size_t row, size_t channel) {
+    if (chunk->missing_count >= chunk->missing_capacity) {
+        size_t new_capacity = chunk->missing_capacity ? chunk->missing_capacity * 2 : 64;
+        MissingCell* new_missing = realloc(chunk->missing, sizeof(MissingCell) * new_capacity);
+        if (!new_missing) return -1;
+        chunk->missing = new_missing;
+        chunk->missing_capacity = new_capacity;
     }
 
-    // Parse header and units
-    char** headers = malloc(MAX_COLUMNS * sizeof(char*));
-    char** unit_tokens = malloc(MAX_COLUMNS * sizeof(char*));
-    int column_count = 0;
-    
-    // Split header line
-    char* token = strtok(header, ",");
-    while (token && column_count < MAX_COLUMNS) {
-        headers[column_count] = strdup(token);
-        trim_whitespace(headers[column_count]);
-        column_count++;
-        token = strtok(NULL, ",");
+    chunk->missing[chunk->missing_count].row = row;
+    chunk->missing[chunk->missing_count].channel = channel;
+    chunk->missing_count++;
+    return 0;
+}
+
+static void count_csv_chunk_rows(void* ctx, size_t index) {
+    CsvParseJob* job = (CsvParseJob*)ctx;
+    CsvChunk* chunk = &job->chunks[index];
+
+    size_t rows = 0;
+    const char* p = chunk->start;
+    while (p < chunk->end) {
+        p = csv_skip_row(p, chunk->end);
+        rows++;
     }
-    
-    // Split units line
-    int unit_count = 0;
-    token = strtok(units, ",");
-    while (token && unit_count < column_count) {
-        unit_tokens[unit_count] = strdup(token);
-        trim_whitespace(unit_tokens[unit_count]);
-        // printf("Debug - Column %d (%s): unit='%s'\n", 
-        //        unit_count, headers[unit_count], unit_tokens[unit_count]);
-        unit_count++;
-        token = strtok(NULL, ",");
-    }
-
-    // Create channels (skip first column which is time)
-    for (int i = 1; i < column_count && i < unit_count; i++) {
-        if (headers[i] && unit_tokens[i]) {
-            Channel* channel = channel_create(headers[i], unit_tokens[i], 3, 1000);
-            if (channel) {
-                log->channels[log->channel_count++] = channel;
-            }
-        }
+    chunk->row_capacity = rows;
+}
+
+static void parse_csv_chunk(void* ctx, size_t index) {
+    CsvParseJob* job = (CsvParseJob*)ctx;
+    CsvChunk* chunk = &job->chunks[index];
+
+    chunk->decimals = calloc(job->channel_count ? job->channel_count : 1, sizeof(int));
+    if (!chunk->decimals) {
+        chunk->failed = 1;
+        return;
     }
 
-    // Parse data rows
-    double first_timestamp = -1;
-    double last_timestamp = 0;
-    
-    while (fgets(line, MAX_LINE_LENGTH, f)) {
-        char* value_str = strtok(line, ",");
-        if (!value_str || !is_numeric(value_str)) continue;
-        
-        double timestamp = atof(value_str);
-        if (first_timestamp < 0) first_timestamp = timestamp;
-        last_timestamp = timestamp;
-        
+    double* timestamps = job->time->timestamps + chunk->row_offset;
+    Channel** channels = job->log->channels;
+
+    CsvRow row;
+    csv_row_init(&row);
+
+    const char* p = chunk->start;
+    while (p < chunk->end && chunk->row_count < chunk->row_capacity) {
+        p = csv_split_row(p, chunk->end, &row);
+
+        double timestamp;
+        CsvField* time_field = &row.fields[0];
+        if (!csv_parse_number(time_field->start, time_field->len, &timestamp, NULL)) continue;
+
+        size_t r = chunk->row_count++;
+        timestamps[r] = timestamp;
+
         // Process each channel's value
-        for (size_t i = 0; i < log->channel_count; i++) {
-            value_str = strtok(NULL, ",");
-            if (value_str && is_numeric(value_str)) {
-                double value = atof(value_str);
-                Channel* channel = log->channels[i];
-                
-                if (channel->message_count >= channel->message_capacity) {
-                    channel->message_capacity *= 2;
-                    channel->messages = realloc(channel->messages, 
-                        channel->message_capacity * sizeof(Message));
-                }
-                
-                channel->messages[channel->message_count].timestamp = timestamp;
-                channel->messages[channel->message_count].value = value;
-                channel->message_count++;
+        for (size_t i = 0; i < job->channel_count; i++) {
+            // Validate, convert and count decimals in a single pass
+            double value = 0.0;
+            int decimals = 0;
+            size_t f = job->columns[i].field;
+            CsvField* field = f < row.count ? &row.fields[f] : NULL;
+            if (!field || !csv_parse_number(field->start, field->len, &value, &decimals)) {
+                if (csv_chunk_add_missing(chunk, r, i) != 0) chunk->failed = 1;
+            } else if (decimals > chunk->decimals[i]) {
+                chunk->decimals[i] = decimals;
             }
+            channels[i]->values[chunk->row_offset + r] = value;
         }
     }
 
-    // Calculate frequency for each channel
-    double duration = last_timestamp - first_timestamp;
-    if (duration > 0) {
-        for (size_t i = 0; i < log->channel_count; i++) {
+    csv_row_free(&row);
+}
+
+// Closes the gaps left by lines that turned out not to be data rows, the
+// index past the last channel is the time column itself
+static void compact_csv_column(void* ctx, size_t index) {
+    CsvParseJob* job = (CsvParseJob*)ctx;
+    double* values = index < job->channel_count ?
+        job->log->channels[index]->values : job->time->timestamps;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < job->chunk_count; i++) {
+        CsvChunk* chunk = &job->chunks[i];
+        if (offset != chunk->row_offset && chunk->row_count > 0) {
+            memmove(values + offset, values + chunk->row_offset, sizeof(double) * chunk->row_count);
+        }
+        offset += chunk->row_count;
+    }
+}
+
+static void free_csv_chunk(CsvChunk* chunk) {
+    free(chunk->decimals);
+    free(chunk->missing);
+}
+
+// Parses the data rows from p on into one channel per column, all columns
+// share a time axis taken from the first field
+static int parse_csv_columns(DataLog* log, const char* p, const char* end,
+                             const CsvColumn* columns, size_t column_count) {
+    // Split the data rows into line aligned chunks, several per thread so a
+    // slow chunk doesn't hold everyone up
+    ThreadPool* pool = thread_pool_default();
+    size_t data_size = (size_t)(end - p);
+    size_t chunk_count = (size_t)thread_pool_size(pool) * CSV_CHUNKS_PER_THREAD;
+    if (chunk_count > data_size / CSV_MIN_CHUNK_SIZE) chunk_count = data_size / CSV_MIN_CHUNK_SIZE;
+    if (chunk_count == 0) chunk_count = 1;
+
+    CsvParseJob job;
+    job.log = log;
+    job.time = NULL;
+    job.chunk_count = chunk_count;
+    job.columns = columns;
+    job.channel_count = 0;
+    job.chunks = calloc(chunk_count, sizeof(CsvChunk));
+    if (!job.chunks) return -1;
+
+    const char* chunk_start = p;
+    for (size_t i = 0; i < chunk_count; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < chunk_count) {
+            chunk_end = p + data_size / chunk_count * (i + 1);
+            if (chunk_end < chunk_start) chunk_end = chunk_start;
+            chunk_end = csv_skip_row(chunk_end, end);
+        }
+        job.chunks[i].start = chunk_start;
+        job.chunks[i].end = chunk_end;
+        chunk_start = chunk_end;
+    }
+
+    // Line counts give each chunk its slice of the columns
+    thread_pool_parallel_for(pool, chunk_count, count_csv_chunk_rows, &job);
+
+    size_t row_capacity = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        job.chunks[i].row_offset = row_capacity;
+        row_capacity += job.chunks[i].row_capacity;
+    }
+
+    // All columns of the file share one time axis
+    int result = 0;
+    job.time = datalog_create_time_axis(log, row_capacity);
+    if (!job.time) result = -1;
+
+    for (size_t i = 0; result == 0 && i < column_count; i++) {
+        char* name = field_strdup(&columns[i].name);
+        char* unit = field_strdup(&columns[i].units);
+        Channel* channel = (name && unit) ? channel_create_on_axis(name, unit, 0, job.time) : NULL;
+        free(name);
+        free(unit);
+
+        if (!channel || datalog_append_channel(log, channel) != 0) {
+            channel_destroy(channel);
+            result = -1;
+        }
+    }
+    job.channel_count = log->channel_count;
+
+    if (result == 0) {
+        thread_pool_parallel_for(pool, chunk_count, parse_csv_chunk, &job);
+    }
+
+    size_t row_count = 0;
+    int has_gaps = 0;
+    for (size_t i = 0; result == 0 && i < chunk_count; i++) {
+        if (job.chunks[i].failed) result = -1;
+        if (job.chunks[i].row_count != job.chunks[i].row_capacity) has_gaps = 1;
+        row_count += job.chunks[i].row_count;
+    }
+
+    if (result == 0 && has_gaps) {
+        thread_pool_parallel_for(pool, job.channel_count + 1, compact_csv_column, &job);
+    }
+
+    if (result == 0) {
+        job.time->count = row_count;
+        for (size_t i = 0; i < job.channel_count; i++) {
             Channel* channel = log->channels[i];
-            if (channel->message_count > 1) {
-                channel->frequency = (channel->message_count - 1) / duration;
-                // printf("Debug - Channel %s: %zu messages over %.3fs = %.2f Hz\n", // Debug
-                //        channel->name, channel->message_count, duration, channel->frequency);
+            channel->message_count = row_count;
+
+            // Everything is valid apart from the missing cells below
+            memset(channel->valid, 0xff, sizeof(uint64_t) * (row_count / 64));
+            for (size_t r = row_count / 64 * 64; r < row_count; r++) {
+                channel->valid[r / 64] |= 1ULL << (r % 64);
+            }
+
+            for (size_t c = 0; c < chunk_count; c++) {
+                if (job.chunks[c].decimals[i] > channel->decimals) {
+                    channel->decimals = job.chunks[c].decimals[i];
+                }
+            }
+        }
+
+        // Missing cells are listed in row order, so holding the previous
+        // value always copies one that is already final
+        size_t offset = 0;
+        for (size_t c = 0; c < chunk_count; c++) {
+            CsvChunk* chunk = &job.chunks[c];
+            for (size_t m = 0; m < chunk->missing_count; m++) {
+                size_t r = offset + chunk->missing[m].row;
+                Channel* channel = log->channels[chunk->missing[m].channel];
+                channel->valid[r / 64] &= ~(1ULL << (r % 64));
+                channel->values[r] = r > 0 ? channel->values[r - 1] : 0.0;
+            }
+            offset += chunk->row_count;
+        }
+
+        // Calculate frequency for each channel
+        double duration = row_count > 0 ?
+            job.time->timestamps[row_count - 1] - job.time->timestamps[0] : 0.0;
+        if (duration > 0) {
+            for (size_t i = 0; i < job.channel_count; i++) {
+                Channel* channel = log->channels[i];
+                if (channel->message_count > 1) {
+                    channel->frequency = (channel->message_count - 1) / duration;
+                }
             }
         }
     }
 
-    // Cleanup
-    for (int i = 0; i < column_count; i++) {
-        free(headers[i]);
-        if (i < unit_count) free(unit_tokens[i]);
+    for (size_t i = 0; i < chunk_count; i++) {
+        free_csv_chunk(&job.chunks[i]);
+    }
+    free(job.chunks);
+    time_axis_release(job.time);
+
+    return result;
+}
+
+int datalog_from_csv_buffer(DataLog* log, const char* data, size_t size) {
+    if (!log || !data) return -1;
+
+    const char* p = data;
+    const char* end = data + size;
+
+    CsvRow header;
+    CsvRow units;
+    csv_row_init(&header);
+    csv_row_init(&units);
+
+    // Header and units lines, the first column is time
+    p = csv_split_row(p, end, &header);
+    p = csv_split_row(p, end, &units);
+
+    size_t column_count = header.count < units.count ? header.count : units.count;
+    column_count = column_count > 0 ? column_count - 1 : 0;
+    CsvColumn* columns = malloc(sizeof(CsvColumn) * (column_count ? column_count : 1));
+    int result = columns ? 0 : -1;
+
+    for (size_t i = 0; result == 0 && i < column_count; i++) {
+        columns[i].field = i + 1;
+        columns[i].name = header.fields[i + 1];
+        columns[i].units = units.fields[i + 1];
+    }
+
+    if (result == 0) result = parse_csv_columns(log, p, end, columns, column_count);
+
+    free(columns);
+    csv_row_free(&header);
+    csv_row_free(&units);
+    return result;
+}
+
+static int field_contains(const CsvField* field, const char* str) {
+    size_t len = strlen(str);
+    for (size_t i = 0; i + len <= field->len; i++) {
+        if (memcmp(field->start + i, str, len) == 0) return 1;
     }
-    free(headers);
-    free(unit_tokens);
-    free(header);
-    free(units);
-    
     return 0;
 }
 
+// Accessport headers are "Name (Units)", split at the last " ("
+static void split_accessport_header(const CsvField* header, CsvField* name, CsvField* units) {
+    *name = *header;
+    units->start = header->start + header->len;
+    units->len = 0;
+
+    for (size_t i = header->len; i >= 2; i--) {
+        if (header->start[i - 2] == ' ' && header->start[i - 1] == '(') {
+            name->len = i - 2;
+            units->start = header->start + i;
+            units->len = header->len - i;
+            if (units->len > 0 && units->start[units->len - 1] == ')') units->len--;
+            break;
+        }
+    }
+}
+
+int datalog_from_accessport_buffer(DataLog* log, const char* data, size_t size) {
+    if (!log || !data) return -1;
+
+    const char* p = data;
+    const char* end = data + size;
+
+    // A single header line, the first column is time
+    CsvRow header;
+    csv_row_init(&header);
+    p = csv_split_row(p, end, &header);
+
+    CsvColumn* columns = malloc(sizeof(CsvColumn) * (header.count ? header.count : 1));
+    int result = columns ? 0 : -1;
+
+    // The AP Info column holds no data, it's left out before any row is read
+    size_t column_count = 0;
+    for (size_t i = 1; result == 0 && i < header.count; i++) {
+        if (field_contains(&header.fields[i], "AP Info")) continue;
+
+        CsvColumn* column = &columns[column_count++];
+        column->field = i;
+        split_accessport_header(&header.fields[i], &column->name, &column->units);
+    }
+
+    if (result == 0) result = parse_csv_columns(log, p, end, columns, column_count);
+
+    free(columns);
+    csv_row_free(&header);
+    return result;
+}
+
+int datalog_from_csv_log(DataLog* log, FILE* f) {
+    if (!f) return -1;
+
+    // Map the file and tokenize in place, no line buffer and no line length cap
+    MappedFile map;
+    if (mapped_file_from_stream(&map, f) != 0) return -1;
+
+    int result = datalog_from_csv_buffer(log, map.data, map.size);
+    mapped_file_close(&map);
+    return result;
+}
+
+int datalog_from_csv(DataLog* log, const char* filename) {
+    MappedFile map;
+    if (mapped_file_open(&map, filename) != 0) return -1;
+
+    int result = datalog_from_csv_buffer(log, map.data, map.size);
+    mapped_file_close(&map);
+    return result;
+}
+
 // end function
 
 
@@ -175,8 +471,7 @@ void data_log_print_channels(DataLog* log) {
 double channel_avg_frequency(Channel* channel) {
     if (channel->message_count < 2) return 0.0;
     
-    double duration = channel->messages[channel->message_count-1].timestamp - 
-                     channel->messages[0].timestamp;
+    double duration = channel_end(channel) - channel_start(channel);
     if (duration <= 0.0) return 0.0;
     
     return (channel->message_count - 1) / duration;
@@ -185,10 +480,17 @@ double channel_avg_frequency(Channel* channel) {
 
 void channel_destroy(Channel* channel) {
     if (channel) {
-        free(channel->name);
-        free(channel->units);
-        free(channel->messages);
-        free(channel);
+        // Sample buffers go back to the arena for the next channel, the rest
+        // only goes with the arena
+        arena_block_release(channel->arena, channel->values, sizeof(double) * channel->message_capacity);
+        arena_block_release(channel->arena, channel->valid,
+                            sizeof(uint64_t) * VALID_WORDS(channel->message_capacity));
+        time_axis_release(channel->time);
+        if (!channel->arena) {
+            free(channel->name);
+            free(channel->units);
+            free(channel);
+        }
     }
 }
 
@@ -207,30 +509,72 @@ void datalog_free(DataLog* log) {
     }
 }
 
-int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path) {
-    // Can stuff, for now returns error
-    // For now returning error
-    return -1;
+int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path, const char* dbc_cache) {
+    if (!log || !f || !dbc_path) return -1;
+
+    Dbc* dbc = dbc_load_cached(dbc_path, dbc_cache);
+    if (!dbc) return -1;
+
+    int result = datalog_from_can_log_dbc(log, f, dbc);
+    dbc_free(dbc);
+    return result;
+}
+
+int datalog_from_can_log_dbc(DataLog* log, FILE* f, const Dbc* dbc) {
+    if (!log || !f || !dbc) return -1;
+
+    MappedFile map;
+    if (mapped_file_from_stream(&map, f) != 0) return -1;
+
+    int result = datalog_from_can_buffer(log, map.data, map.size, dbc);
+    mapped_file_close(&map);
+    return result;
+}
+
+int datalog_from_can_buffer(DataLog* log, const char* data, size_t size, const Dbc* dbc) {
+    if (!log || !data || !dbc) return -1;
+    if (can_log_decode(log, data, size, dbc) != 0) return -1;
+
+    // Each message has its own rate
+    for (size_t i = 0; i < log->channel_count; i++) {
+        Channel* channel = log->channels[i];
+        double duration = channel_end(channel) - channel_start(channel);
+        if (channel->message_count > 1 && duration > 0) {
+            channel->frequency = (channel->message_count - 1) / duration;
+        }
+    }
+    return 0;
 }
 
 
 int datalog_from_accessport_log(DataLog* log, FILE* f) {
-    // Implementation depends on Accessport format
-    // For now returning error
-    return -1;
+    if (!f) return -1;
+
+    MappedFile map;
+    if (mapped_file_from_stream(&map, f) != 0) return -1;
+
+    int result = datalog_from_accessport_buffer(log, map.data, map.size);
+    mapped_file_close(&map);
+    return result;
 }
 // ********
 
 ////////////
 
 void datalog_add_channel(DataLog* log, const char* name, const char* units, int decimals) {
-    if (log->channel_count >= log->channel_capacity) {
-        log->channel_capacity *= 2;
-        log->channels = realloc(log->channels, sizeof(Channel*) * log->channel_capacity);
+    TimeAxis* time = datalog_create_time_axis(log, 1000);
+    Channel* channel = channel_create_on_axis(name, units, decimals, time);
+    time_axis_release(time);
+    if (channel && datalog_append_channel(log, channel) != 0) {
+        channel_destroy(channel);
     }
-    
-    Channel* channel = channel_create(name, units, decimals, 1000);
-    log->channels[log->channel_count++] = channel;
+}
+
+Channel* datalog_get_channel(DataLog* log, const char* name) {
+    if (!log || !name) return NULL;
+
+    int index = name_index_find(&log->names, name);
+    return index >= 0 ? log->channels[index] : NULL;
 }
 
 double datalog_start(DataLog* log) {
@@ -255,34 +599,395 @@ double datalog_end(DataLog* log) {
     return latest;
 }
 
+// Channels that share a source time axis, they also share the mapping from
+// grid points to source samples
+typedef struct {
+    TimeAxis* source;
+    size_t source_count;
+    size_t* members;       // Slice of ResampleJob.members
+    size_t member_count;
+} ResampleGroup;
+
+typedef struct {
+    Channel** channels;
+    double** values;
+    uint64_t** valid;
+    ResampleGroup* groups;
+    size_t group_count;
+    size_t* members;
+    TimeAxis* time;
+    size_t sample_count;
+    size_t block_count;
+    double start;
+    double step;
+} ResampleJob;
+
+// One block of the output grid for every channel of one group. Blocks are a
+// multiple of 64 samples so each task owns whole words of the bitmaps.
+static void resample_block(void* ctx, size_t index) {
+    ResampleJob* job = (ResampleJob*)ctx;
+    ResampleGroup* group = &job->groups[index / job->block_count];
+    size_t first = (index % job->block_count) * RESAMPLE_BLOCK_SIZE;
+    size_t last = first + RESAMPLE_BLOCK_SIZE;
+    if (last > job->sample_count) last = job->sample_count;
+
+    const double* timestamps = group->source->timestamps;
+    size_t source_count = group->source_count;
+    double half_step = 0.5 * job->step;
+
+    // The first group also lays down the new grid
+    if (index < job->block_count) {
+        for (size_t i = first; i < last; i++) {
+            job->time->timestamps[i] = job->start + (double)i * job->step;
+        }
+    }
+
+    // Source samples consumed before this block, found by bisection so the
+    // blocks don't depend on each other
+    double limit = job->start + (double)first * job->step + half_step;
+    size_t lo = 0;
+    size_t hi = source_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (timestamps[mid] < limit) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Merge the grid against the source, consumed[i] is how many source
+    // samples fall before the end of grid point i's window
+    size_t consumed[RESAMPLE_BLOCK_SIZE];
+    size_t k = lo;
+    for (size_t i = first; i < last; i++) {
+        limit = job->start + (double)i * job->step + half_step;
+        while (k < source_count && timestamps[k] < limit) k++;
+        consumed[i - first] = k;
+    }
+
+    // Zero order hold, the latest consumed sample or 0 before the first one
+    for (size_t m = 0; m < group->member_count; m++) {
+        size_t c = group->members[m];
+        size_t count = job->channels[c]->message_count;
+        const double* src = job->channels[c]->values;
+        double* dst = job->values[c];
+        uint64_t* valid = job->valid[c];
+
+        for (size_t i = first; i < last; i++) {
+            size_t n = consumed[i - first] < count ? consumed[i - first] : count;
+            dst[i] = n ? src[n - 1] : 0.0;
+        }
+
+        for (size_t i = first; i < last; i += 64) {
+            uint64_t word = 0;
+            for (size_t b = 0; b < 64 && i + b < last; b++) {
+                if (consumed[i + b - first] > 0) word |= 1ULL << b;
+            }
+            valid[i / 64] = word;
+        }
+    }
+}
+
+static void free_resample_job(ResampleJob* job, size_t channel_count) {
+    size_t values_size = sizeof(double) * job->sample_count;
+    size_t valid_size = sizeof(uint64_t) * VALID_WORDS(job->sample_count);
+    for (size_t i = 0; i < channel_count; i++) {
+        Arena* arena = job->channels[i]->arena;
+        if (job->values) arena_block_release(arena, job->values[i], values_size);
+        if (job->valid) arena_block_release(arena, job->valid[i], valid_size);
+    }
+    free(job->members);
+    free(job->values);
+    free(job->valid);
+    free(job->groups);
+    time_axis_release(job->time);
+}
+
+int datalog_resample(DataLog* log, double frequency) {
+    if (!log || frequency <= 0.0) return -1;
+    if (log->channel_count == 0) return 0;
+
+    double start = datalog_start(log);
+    double end = datalog_end(log);
+    double samples = floor(frequency * (end - start));
+
+    ResampleJob job;
+    memset(&job, 0, sizeof(ResampleJob));
+    job.channels = log->channels;
+    job.sample_count = samples > 0 ? (size_t)samples : 0;
+    job.block_count = (job.sample_count + RESAMPLE_BLOCK_SIZE - 1) / RESAMPLE_BLOCK_SIZE;
+    job.start = start;
+    job.step = 1.0 / frequency;
+
+    // Every channel ends up on the same grid
+    job.time = datalog_create_time_axis(log, job.sample_count);
+    job.values = calloc(log->channel_count, sizeof(double*));
+    job.valid = calloc(log->channel_count, sizeof(uint64_t*));
+    job.groups = calloc(log->channel_count, sizeof(ResampleGroup));
+    job.members = malloc(sizeof(size_t) * log->channel_count);
+    size_t* group_of = malloc(sizeof(size_t) * log->channel_count);
+    if (!job.time || !job.values || !job.valid || !job.groups || !job.members || !group_of) {
+        free(group_of);
+        free_resample_job(&job, log->channel_count);
+        return -1;
+    }
+
+    for (size_t i = 0; i < log->channel_count; i++) {
+        Channel* channel = log->channels[i];
+        size_t values_size = sizeof(double) * job.sample_count;
+        size_t valid_size = sizeof(uint64_t) * VALID_WORDS(job.sample_count);
+        job.values[i] = arena_block_alloc(channel->arena, &values_size);
+        job.valid[i] = arena_block_alloc(channel->arena, &valid_size);
+        if (job.valid[i]) memset(job.valid[i], 0, valid_size);
+        if (!job.values[i] || !job.valid[i]) {
+            free(group_of);
+            free_resample_job(&job, log->channel_count);
+            return -1;
+        }
+
+        // Empty channels stay empty
+        group_of[i] = SIZE_MAX;
+        if (channel->message_count == 0) continue;
+
+        size_t g = 0;
+        while (g < job.group_count && job.groups[g].source != channel->time) g++;
+        if (g == job.group_count) {
+            job.groups[job.group_count++].source = channel->time;
+        }
+        group_of[i] = g;
+        job.groups[g].member_count++;
+        if (channel->message_count > job.groups[g].source_count) {
+            job.groups[g].source_count = channel->message_count;
+        }
+    }
+
+    // Lay the members of each group out next to each other
+    size_t offset = 0;
+    for (size_t g = 0; g < job.group_count; g++) {
+        job.groups[g].members = job.members + offset;
+        offset += job.groups[g].member_count;
+        job.groups[g].member_count = 0;
+    }
+    for (size_t i = 0; i < log->channel_count; i++) {
+        if (group_of[i] == SIZE_MAX) continue;
+        ResampleGroup* group = &job.groups[group_of[i]];
+        group->members[group->member_count++] = i;
+    }
+    free(group_of);
+
+    ThreadPool* pool = thread_pool_default();
+    if (job.group_count > 0) {
+        thread_pool_parallel_for(pool, job.group_count * job.block_count, resample_block, &job);
+    }
+    job.time->count = job.sample_count;
+
+    // Swap the resampled columns in
+    for (size_t i = 0; i < log->channel_count; i++) {
+        Channel* channel = log->channels[i];
+        int empty = channel->message_count == 0;
+
+        arena_block_release(channel->arena, channel->values, sizeof(double) * channel->message_capacity);
+        arena_block_release(channel->arena, channel->valid,
+                            sizeof(uint64_t) * VALID_WORDS(channel->message_capacity));
+        channel->values = job.values[i];
+        channel->valid = job.valid[i];
+        job.values[i] = NULL;
+        job.valid[i] = NULL;
+
+        time_axis_release(channel->time);
+        channel->time = time_axis_retain(job.time);
+        channel->message_capacity = job.sample_count;
+        channel->message_count = empty ? 0 : job.sample_count;
+        channel->frequency = frequency;
+    }
+
+    free_resample_job(&job, log->channel_count);
+    return 0;
+}
+
 //////////
 
 // 888888888
 
-Channel* channel_create(const char* name, const char* units, int decimals, size_t initial_size) {
-    Channel* channel = (Channel*)malloc(sizeof(Channel));
+static TimeAxis* time_axis_create_in(Arena* arena, size_t initial_size) {
+    TimeAxis* time = (TimeAxis*)arena_alloc(arena, sizeof(TimeAxis));
+    if (!time) return NULL;
+
+    if (initial_size == 0) initial_size = 1;
+    size_t size = sizeof(double) * initial_size;
+    time->arena = arena;
+    time->timestamps = (double*)arena_block_alloc(arena, &size);
+    if (!time->timestamps) {
+        if (!arena) free(time);
+        return NULL;
+    }
+    time->count = 0;
+    time->capacity = size / sizeof(double);
+    time->refs = 1;
+
+    return time;
+}
+
+TimeAxis* time_axis_create(size_t initial_size) {
+    return time_axis_create_in(NULL, initial_size);
+}
+
+// An axis whose channels all allocate from the log's arena
+TimeAxis* datalog_create_time_axis(DataLog* log, size_t initial_size) {
+    return time_axis_create_in(&log->arena, initial_size);
+}
+
+TimeAxis* time_axis_retain(TimeAxis* time) {
+    if (time) time->refs++;
+    return time;
+}
+
+void time_axis_release(TimeAxis* time) {
+    if (time && --time->refs == 0) {
+        arena_block_release(time->arena, time->timestamps, sizeof(double) * time->capacity);
+        if (!time->arena) free(time);
+    }
+}
+
+int time_axis_append(TimeAxis* time, double timestamp) {
+    if (time->count >= time->capacity) {
+        size_t size = sizeof(double) * time->capacity * 2;
+        double* new_timestamps = arena_block_realloc(time->arena, time->timestamps,
+            sizeof(double) * time->capacity, &size);
+        if (!new_timestamps) return -1;
+        time->timestamps = new_timestamps;
+        time->capacity = size / sizeof(double);
+    }
+
+    time->timestamps[time->count++] = timestamp;
+    return 0;
+}
+
+Channel* channel_create_on_axis(const char* name, const char* units, int decimals, TimeAxis* time) {
+    if (!time) return NULL;
+
+    Channel* channel = (Channel*)arena_alloc(time->arena, sizeof(Channel));
     if (!channel) return NULL;
-    
-    channel->name = strdup(name);
-    channel->units = strdup(units);
+
+    channel->arena = time->arena;
+    channel->name = arena_strdup(channel->arena, name);
+    channel->units = arena_strdup(channel->arena, units);
     channel->decimals = decimals;
+    channel->time = time_axis_retain(time);
+    channel->values = NULL;
+    channel->valid = NULL;
     channel->message_count = 0;
-    channel->message_capacity = initial_size;
-    channel->messages = (Message*)malloc(sizeof(Message) * initial_size);
+    channel->message_capacity = 0;
     channel->data_type = NULL;
     channel->frequency = 0.0;
-    
+
+    if (channel_reserve(channel, time->capacity) != 0) {
+        channel_destroy(channel);
+        return NULL;
+    }
+
+    return channel;
+}
+
+Channel* channel_create(const char* name, const char* units, int decimals, size_t initial_size) {
+    // A channel on its own gets a private time axis
+    TimeAxis* time = time_axis_create(initial_size);
+    Channel* channel = channel_create_on_axis(name, units, decimals, time);
+    time_axis_release(time);
     return channel;
 }
 
+int channel_reserve(Channel* channel, size_t capacity) {
+    if (capacity <= channel->message_capacity) return 0;
+
+    // The arena rounds up to its size class, the slack is capacity too
+    size_t size = sizeof(double) * capacity;
+    double* new_values = arena_block_realloc(channel->arena, channel->values,
+        sizeof(double) * channel->message_capacity, &size);
+    if (!new_values) return -1;
+    channel->values = new_values;
+    capacity = size / sizeof(double);
+
+    size_t old_words = VALID_WORDS(channel->message_capacity);
+    size_t new_words = VALID_WORDS(capacity);
+    size_t valid_size = sizeof(uint64_t) * new_words;
+    uint64_t* new_valid = arena_block_realloc(channel->arena, channel->valid,
+        sizeof(uint64_t) * old_words, &valid_size);
+    if (!new_valid) return -1;
+    memset(new_valid + old_words, 0, sizeof(uint64_t) * (new_words - old_words));
+    channel->valid = new_valid;
+
+    channel->message_capacity = capacity;
+    return 0;
+}
+
+static int channel_grow(Channel* channel) {
+    if (channel->message_count < channel->message_capacity) return 0;
+    size_t capacity = channel->message_capacity ? channel->message_capacity * 2 : 1000;
+    return channel_reserve(channel, capacity);
+}
+
+int channel_append(Channel* channel, double value) {
+    if (channel_grow(channel) != 0) return -1;
+
+    size_t i = channel->message_count++;
+    channel->values[i] = value;
+    channel->valid[i / 64] |= 1ULL << (i % 64);
+    return 0;
+}
+
+int channel_append_values(Channel* channel, const double* values, size_t count) {
+    if (channel->message_count + count > channel->message_capacity) {
+        size_t capacity = channel->message_capacity ? channel->message_capacity : 1000;
+        while (capacity < channel->message_count + count) capacity *= 2;
+        if (channel_reserve(channel, capacity) != 0) return -1;
+    }
+
+    size_t first = channel->message_count;
+    memcpy(channel->values + first, values, sizeof(double) * count);
+    for (size_t i = first; i < first + count; i++) {
+        channel->valid[i / 64] |= 1ULL << (i % 64);
+    }
+    channel->message_count += count;
+    return 0;
+}
+
+int channel_append_missing(Channel* channel) {
+    if (channel_grow(channel) != 0) return -1;
+
+    // Hold the last value so the column stays usable without the bitmap
+    size_t i = channel->message_count++;
+    channel->values[i] = i > 0 ? channel->values[i - 1] : 0.0;
+    channel->valid[i / 64] &= ~(1ULL << (i % 64));
+    return 0;
+}
+
+int channel_is_valid(const Channel* channel, size_t index) {
+    if (index >= channel->message_count) return 0;
+    return (channel->valid[index / 64] >> (index % 64)) & 1;
+}
+
+size_t channel_valid_count(const Channel* channel) {
+    size_t count = 0;
+    size_t words = channel->message_count / 64;
+    for (size_t i = 0; i < words; i++) {
+        count += (size_t)__builtin_popcountll(channel->valid[i]);
+    }
+    for (size_t i = words * 64; i < channel->message_count; i++) {
+        count += channel_is_valid(channel, i);
+    }
+    return count;
+}
+
 double channel_start(Channel* channel) {
     if (!channel || channel->message_count == 0) return 0.0;
-    return channel->messages[0].timestamp;
+    return channel->time->timestamps[0];
 }
 
 double channel_end(Channel* channel) {
     if (!channel || channel->message_count == 0) return 0.0;
-    return channel->messages[channel->message_count - 1].timestamp;
+    return channel->time->timestamps[channel->message_count - 1];
 }
 
 // 88888888
@@ -299,19 +1004,3 @@ void trim_whitespace(char* str) {
     end[1] = '\0';
 }
 
-
-// Helper function to split CSV line
-char** split_csv_line(char* line, int* count) {
-    char** tokens = malloc(MAX_COLUMNS * sizeof(char*));
-    *count = 0;
-    char* token = strtok(line, ",");
-    
-    while (token != NULL && *count < MAX_COLUMNS) {
-        tokens[*count] = strdup(token);
-        trim_whitespace(tokens[*count]);
-        (*count)++;
-        token = strtok(NULL, ",");
-    }
-    
-    return tokens;
-}
\ No newline at end of file
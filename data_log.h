@@ -4,41 +4,63 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <float.h>
 #include <math.h>
+#include "name_index.h"
+#include "arena.h"
+#include "dbc.h"
 
-// Message structure
-typedef struct Message {
-    double timestamp;
-    double value;
-} Message;
+// Timestamps shared by every channel sampled at the same instants, e.g. all
+// columns of a CSV file. Reference counted by the channels using it.
+typedef struct TimeAxis {
+    Arena* arena;       // Where the axis and its channels allocate, NULL for the heap
+    double* timestamps;
+    size_t count;
+    size_t capacity;
+    int refs;
+} TimeAxis;
 
-// Channel structure
+// Channel structure, stored column wise. values[i] was sampled at
+// time->timestamps[i]; samples missing from the source have their bit in
+// valid cleared and hold the previous value (0 before the first one).
 typedef struct Channel {
+    Arena* arena;       // Same as the time axis it was created on
     char* name;
     char* units;
     int decimals;
-    Message* messages;
+    TimeAxis* time;
+    double* values;
+    uint64_t* valid;
     size_t message_count;
     size_t message_capacity;
     double (*data_type)(double); 
     double frequency;
 } Channel;
 
-// DataLog structure
+// DataLog structure. Names, channels, time axes and sample buffers all come
+// out of the log's arena, so destroying a log is a bulk free rather than one
+// per allocation. Channels created elsewhere and appended keep their own
+// memory and are destroyed one by one.
 typedef struct DataLog {
     char* name;
     Channel** channels;
     size_t channel_count;
     size_t channel_capacity;
+    NameIndex names;    // Channel name to index in channels
+    Arena arena;
 } DataLog;
 
 
 void trim_whitespace(char* str);
 
-int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path);
+int datalog_from_can_log(DataLog* log, FILE* f, const char* dbc_path, const char* dbc_cache);
+int datalog_from_can_log_dbc(DataLog* log, FILE* f, const Dbc* dbc);
+int datalog_from_can_buffer(DataLog* log, const char* data, size_t size, const Dbc* dbc);
 int datalog_from_csv_log(DataLog* log, FILE* f);
+int datalog_from_csv_buffer(DataLog* log, const char* data, size_t size);
 int datalog_from_accessport_log(DataLog* log, FILE* f);
+int datalog_from_accessport_buffer(DataLog* log, const char* data, size_t size);
 int datalog_channel_count(DataLog* log);
 void datalog_free(DataLog* log);
 void data_log_print_channels(DataLog* log);
@@ -46,15 +68,31 @@ DataLog* datalog_create(const char* name);
 void datalog_destroy(DataLog* log);
 void datalog_clear(DataLog* log);
 void datalog_add_channel(DataLog* log, const char* name, const char* units, int decimals);
+int datalog_append_channel(DataLog* log, Channel* channel);
+TimeAxis* datalog_create_time_axis(DataLog* log, size_t initial_size);
+Channel* datalog_get_channel(DataLog* log, const char* name);
 double datalog_start(DataLog* log);
 double datalog_end(DataLog* log);
 double datalog_duration(DataLog* log);
-void datalog_resample(DataLog* log, double frequency);
+int datalog_resample(DataLog* log, double frequency);
 int datalog_from_csv(DataLog* log, const char* filename);
 
+// Time axis functions
+TimeAxis* time_axis_create(size_t initial_size);
+TimeAxis* time_axis_retain(TimeAxis* time);
+void time_axis_release(TimeAxis* time);
+int time_axis_append(TimeAxis* time, double timestamp);
+
 // Channel functions
 Channel* channel_create(const char* name, const char* units, int decimals, size_t initial_size);
+Channel* channel_create_on_axis(const char* name, const char* units, int decimals, TimeAxis* time);
 void channel_destroy(Channel* channel);
+int channel_reserve(Channel* channel, size_t capacity);
+int channel_append(Channel* channel, double value);
+int channel_append_values(Channel* channel, const double* values, size_t count);
+int channel_append_missing(Channel* channel);
+int channel_is_valid(const Channel* channel, size_t index);
+size_t channel_valid_count(const Channel* channel);
 double channel_start(Channel* channel);
 double channel_end(Channel* channel);
 double channel_avg_frequency(Channel* channel);
@@ -0,0 +1,390 @@
+#include "dbc.h"
+#include "mapped_file.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_MESSAGE_CAPACITY 64
+#define INITIAL_SIGNAL_CAPACITY 8
+#define DBC_DECODE_BATCH 256
+#define DBC_INDEPENDENT_SIG_MSG 0xc0000000ul
+
+// Cursor over one line of the DBC text
+typedef struct {
+    const char* p;
+    const char* end;
+} DbcLine;
+
+static void skip_spaces(DbcLine* line) {
+    while (line->p < line->end && (*line->p == ' ' || *line->p == '\t' || *line->p == '\r')) {
+        line->p++;
+    }
+}
+
+static int accept(DbcLine* line, char c) {
+    skip_spaces(line);
+    if (line->p < line->end && *line->p == c) {
+        line->p++;
+        return 1;
+    }
+    return 0;
+}
+
+// Next run of characters up to whitespace or any of stop
+static size_t token(DbcLine* line, const char* stop, const char** start) {
+    skip_spaces(line);
+    *start = line->p;
+    while (line->p < line->end && *line->p != ' ' && *line->p != '\t' &&
+           *line->p != '\r' && !strchr(stop, *line->p)) {
+        line->p++;
+    }
+    return (size_t)(line->p - *start);
+}
+
+static char* token_dup(const char* start, size_t len) {
+    char* str = malloc(len + 1);
+    if (!str) return NULL;
+    memcpy(str, start, len);
+    str[len] = '\0';
+    return str;
+}
+
+// Lines aren't NUL terminated, numbers are copied out before converting
+static int number_token(DbcLine* line, char* buffer, size_t size) {
+    const char* start;
+    size_t len = token(line, ",|@():[];", &start);
+    if (len == 0 || len >= size) return -1;
+    memcpy(buffer, start, len);
+    buffer[len] = '\0';
+    return 0;
+}
+
+static int parse_long(DbcLine* line, long* value) {
+    char buffer[32];
+    char* after;
+    if (number_token(line, buffer, sizeof(buffer)) != 0) return -1;
+    *value = strtol(buffer, &after, 10);
+    return *after == '\0' ? 0 : -1;
+}
+
+static int parse_unsigned(DbcLine* line, unsigned long* value) {
+    char buffer[32];
+    char* after;
+    if (number_token(line, buffer, sizeof(buffer)) != 0) return -1;
+    *value = strtoul(buffer, &after, 10);
+    return *after == '\0' ? 0 : -1;
+}
+
+static int parse_double(DbcLine* line, double* value) {
+    char buffer[64];
+    char* after;
+    if (number_token(line, buffer, sizeof(buffer)) != 0) return -1;
+    *value = strtod(buffer, &after);
+    return *after == '\0' ? 0 : -1;
+}
+
+static int starts_with(const DbcLine* line, const char* keyword) {
+    size_t len = strlen(keyword);
+    return (size_t)(line->end - line->p) > len && memcmp(line->p, keyword, len) == 0 &&
+           (line->p[len] == ' ' || line->p[len] == '\t');
+}
+
+// BO_ <id> <name>: <dlc> <transmitter>. Vector tools park signals that belong
+// to no frame under VECTOR__INDEPENDENT_SIG_MSG, which is not a real ID and
+// is skipped along with its signals.
+static int parse_message(Dbc* dbc, DbcLine* line) {
+    unsigned long id;
+    long dlc;
+    const char* name;
+
+    line->p += 3;
+    if (parse_unsigned(line, &id) != 0) return -1;
+    size_t name_len = token(line, ":", &name);
+    if (name_len == 0 || !accept(line, ':')) return -1;
+    if (parse_long(line, &dlc) != 0) return -1;
+    if (id == DBC_INDEPENDENT_SIG_MSG) return 0;
+
+    if (dbc->message_count >= dbc->message_capacity) {
+        int new_capacity = dbc->message_capacity ? dbc->message_capacity * 2 : INITIAL_MESSAGE_CAPACITY;
+        DbcMessage* new_messages = realloc(dbc->messages, sizeof(DbcMessage) * new_capacity);
+        if (!new_messages) return -1;
+        dbc->messages = new_messages;
+        dbc->message_capacity = new_capacity;
+    }
+
+    DbcMessage* message = &dbc->messages[dbc->message_count];
+    memset(message, 0, sizeof(DbcMessage));
+    message->id = (uint32_t)id & DBC_ID_MASK;
+    message->extended = (id & DBC_EXTENDED_FLAG) != 0;
+    message->dlc = (int)dlc;
+    message->name = token_dup(name, name_len);
+    if (!message->name) return -1;
+
+    dbc->message_count++;
+    return 0;
+}
+
+// SG_ <name> [M|mN] : <start>|<length>@<order><sign> (<factor>,<offset>) [<min>|<max>] "<unit>" ...
+static int parse_signal(DbcMessage* message, DbcLine* line) {
+    DbcSignal signal;
+    memset(&signal, 0, sizeof(DbcSignal));
+    const char* name;
+    const char* mux;
+
+    line->p += 3;
+    size_t name_len = token(line, ":", &name);
+    if (name_len == 0) return -1;
+
+    // Optional multiplexer marker, "m3M" (extended multiplexing) is read as m3
+    size_t mux_len = token(line, ":", &mux);
+    if (mux_len > 0) {
+        if (mux[0] == 'M') {
+            signal.mux_role = DBC_MUX_SELECTOR;
+        } else if (mux[0] == 'm') {
+            signal.mux_role = DBC_MUX_MULTIPLEXED;
+            signal.mux_value = atoi(mux + 1);
+        } else {
+            return -1;
+        }
+    }
+    if (!accept(line, ':')) return -1;
+
+    long start, length;
+    if (parse_long(line, &start) != 0 || !accept(line, '|')) return -1;
+    if (parse_long(line, &length) != 0 || !accept(line, '@')) return -1;
+    if (length < 1 || length > 64 || start < 0 || start > 511) return -1;
+    signal.start = (int)start;
+    signal.length = (int)length;
+
+    if (line->p + 2 > line->end) return -1;
+    signal.little_endian = line->p[0] == '1';
+    signal.is_signed = line->p[1] == '-';
+    line->p += 2;
+
+    if (!accept(line, '(') || parse_double(line, &signal.factor) != 0 || !accept(line, ',') ||
+        parse_double(line, &signal.offset) != 0 || !accept(line, ')')) return -1;
+
+    // Skip [min|max], then the unit string
+    skip_spaces(line);
+    if (accept(line, '[')) {
+        while (line->p < line->end && *line->p != ']') line->p++;
+        if (!accept(line, ']')) return -1;
+    }
+    const char* unit = "";
+    size_t unit_len = 0;
+    if (accept(line, '"')) {
+        unit = line->p;
+        while (line->p < line->end && *line->p != '"') line->p++;
+        unit_len = (size_t)(line->p - unit);
+    }
+
+    signal.name = token_dup(name, name_len);
+    signal.unit = token_dup(unit, unit_len);
+    if (!signal.name || !signal.unit) {
+        free(signal.name);
+        free(signal.unit);
+        return -1;
+    }
+
+    if (message->signal_count >= message->signal_capacity) {
+        int new_capacity = message->signal_capacity ? message->signal_capacity * 2 : INITIAL_SIGNAL_CAPACITY;
+        DbcSignal* new_signals = realloc(message->signals, sizeof(DbcSignal) * new_capacity);
+        if (!new_signals) {
+            free(signal.name);
+            free(signal.unit);
+            return -1;
+        }
+        message->signals = new_signals;
+        message->signal_capacity = new_capacity;
+    }
+    message->signals[message->signal_count++] = signal;
+    return 0;
+}
+
+// Bit positions are resolved once here so decoding is just shift and mask
+static void compile_signal(DbcSignal* signal) {
+    DbcSignalPlan* plan = &signal->plan;
+    int length = signal->length;
+    int shift;
+
+    if (signal->little_endian) {
+        // Start is the LSB counting up through little endian bytes
+        shift = signal->start;
+    } else {
+        // Start is the MSB in the sawtooth numbering, msb is its position
+        // counted from the first bit of the frame, the top of the swapped word
+        int msb = (signal->start / 8) * 8 + (7 - signal->start % 8);
+        shift = 64 - msb - length;
+    }
+
+    memset(plan, 0, sizeof(DbcSignalPlan));
+    plan->big_endian = !signal->little_endian;
+    plan->value_type = signal->value_type;
+    plan->factor = signal->factor;
+    plan->offset = signal->offset;
+
+    // Signals reaching past 8 bytes decode as 0
+    if (shift < 0 || shift + length > 64) return;
+    plan->shift = shift;
+    plan->mask = length == 64 ? ~0ULL : (1ULL << length) - 1;
+    if (signal->is_signed && signal->value_type == DBC_VALUE_INTEGER) {
+        plan->sign_bit = 1ULL << (length - 1);
+    }
+}
+
+// SIG_VALTYPE_ <id> <signal> : <type>;
+static void parse_value_type(Dbc* dbc, DbcLine* line) {
+    unsigned long id;
+    long type;
+    const char* name;
+
+    line->p += 12;
+    if (parse_unsigned(line, &id) != 0) return;
+    size_t name_len = token(line, ":", &name);
+    if (!accept(line, ':') || parse_long(line, &type) != 0) return;
+
+    for (int m = 0; m < dbc->message_count; m++) {
+        DbcMessage* message = &dbc->messages[m];
+        if (message->id != ((uint32_t)id & DBC_ID_MASK)) continue;
+        if (message->extended != ((id & DBC_EXTENDED_FLAG) != 0)) continue;
+        for (int s = 0; s < message->signal_count; s++) {
+            DbcSignal* signal = &message->signals[s];
+            if (strlen(signal->name) == name_len && memcmp(signal->name, name, name_len) == 0) {
+                signal->value_type = type == 1 ? DBC_VALUE_FLOAT32 :
+                                     type == 2 ? DBC_VALUE_FLOAT64 : DBC_VALUE_INTEGER;
+            }
+        }
+    }
+}
+
+Dbc* dbc_parse(const char* data, size_t size) {
+    Dbc* dbc = calloc(1, sizeof(Dbc));
+    if (!dbc) return NULL;
+
+    const char* p = data;
+    const char* end = data + size;
+    DbcMessage* current = NULL;
+    while (p < end) {
+        const char* newline = memchr(p, '\n', (size_t)(end - p));
+        DbcLine line = { p, newline ? newline : end };
+        p = newline ? newline + 1 : end;
+
+        skip_spaces(&line);
+        int result = 0;
+        if (starts_with(&line, "BO_")) {
+            int count = dbc->message_count;
+            result = parse_message(dbc, &line);
+            current = dbc->message_count > count ? &dbc->messages[count] : NULL;
+        } else if (starts_with(&line, "SG_")) {
+            // Signals belong to the message above them
+            if (current) result = parse_signal(current, &line);
+        } else if (starts_with(&line, "SIG_VALTYPE_")) {
+            parse_value_type(dbc, &line);
+        }
+
+        if (result != 0) {
+            dbc_free(dbc);
+            return NULL;
+        }
+    }
+
+    // Value types come after the signals, so plans are built last
+    for (int m = 0; m < dbc->message_count; m++) {
+        DbcMessage* message = &dbc->messages[m];
+        for (int s = 0; s < message->signal_count; s++) {
+            compile_signal(&message->signals[s]);
+        }
+    }
+
+    return dbc;
+}
+
+Dbc* dbc_load(const char* filename) {
+    MappedFile map;
+    if (mapped_file_open(&map, filename) != 0) return NULL;
+
+    Dbc* dbc = dbc_parse(map.data, map.size);
+    mapped_file_close(&map);
+    return dbc;
+}
+
+void dbc_free(Dbc* dbc) {
+    if (!dbc) return;
+
+    for (int m = 0; m < dbc->message_count; m++) {
+        DbcMessage* message = &dbc->messages[m];
+        if (!dbc->cache) {
+            for (int s = 0; s < message->signal_count; s++) {
+                free(message->signals[s].name);
+                free(message->signals[s].unit);
+            }
+            free(message->name);
+        }
+        free(message->signals);
+    }
+    free(dbc->messages);
+
+    if (dbc->cache) {
+        mapped_file_close(dbc->cache);
+        free(dbc->cache);
+    }
+    free(dbc);
+}
+
+uint64_t dbc_frame_word(const uint8_t* data) {
+    uint64_t word = 0;
+    for (int i = 7; i >= 0; i--) word = (word << 8) | data[i];
+    return word;
+}
+
+uint64_t dbc_plan_raw(const DbcSignalPlan* plan, uint64_t frame) {
+    uint64_t word = plan->big_endian ? __builtin_bswap64(frame) : frame;
+    return (word >> plan->shift) & plan->mask;
+}
+
+void dbc_plan_extract(const DbcSignalPlan* plan, const uint64_t* frames, size_t count, uint64_t* raw) {
+    int shift = plan->shift;
+    uint64_t mask = plan->mask;
+
+    if (plan->big_endian) {
+        for (size_t i = 0; i < count; i++) raw[i] = (__builtin_bswap64(frames[i]) >> shift) & mask;
+    } else {
+        for (size_t i = 0; i < count; i++) raw[i] = (frames[i] >> shift) & mask;
+    }
+}
+
+void dbc_plan_decode(const DbcSignalPlan* plan, const uint64_t* frames, size_t count, double* values) {
+    uint64_t raw[DBC_DECODE_BATCH];
+    double factor = plan->factor;
+    double offset = plan->offset;
+    uint64_t sign_bit = plan->sign_bit;
+
+    for (size_t first = 0; first < count; first += DBC_DECODE_BATCH) {
+        size_t n = count - first < DBC_DECODE_BATCH ? count - first : DBC_DECODE_BATCH;
+        double* out = values + first;
+        dbc_plan_extract(plan, frames + first, n, raw);
+
+        if (plan->value_type == DBC_VALUE_FLOAT32) {
+            for (size_t i = 0; i < n; i++) {
+                uint32_t bits = (uint32_t)raw[i];
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                out[i] = (double)f * factor + offset;
+            }
+        } else if (plan->value_type == DBC_VALUE_FLOAT64) {
+            for (size_t i = 0; i < n; i++) {
+                double d;
+                memcpy(&d, &raw[i], sizeof(d));
+                out[i] = d * factor + offset;
+            }
+        } else if (!sign_bit && plan->mask == ~0ULL) {
+            // Only a full 64 bit unsigned signal doesn't fit an int64_t
+            for (size_t i = 0; i < n; i++) out[i] = (double)raw[i] * factor + offset;
+        } else {
+            // Flipping then subtracting the sign bit sign extends, and
+            // leaves unsigned values (sign_bit 0) alone
+            for (size_t i = 0; i < n; i++) {
+                out[i] = (double)(int64_t)((raw[i] ^ sign_bit) - sign_bit) * factor + offset;
+            }
+        }
+    }
+}
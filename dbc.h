@@ -0,0 +1,86 @@
+#ifndef DBC_H
+#define DBC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mapped_file.h"
+
+#define DBC_EXTENDED_FLAG 0x80000000u
+#define DBC_ID_MASK 0x1fffffffu
+
+// Role of a signal in a multiplexed message
+typedef enum {
+    DBC_MUX_NONE,
+    DBC_MUX_SELECTOR,      // "M", its value picks the active signals
+    DBC_MUX_MULTIPLEXED    // "mN", only present when the selector is N
+} DbcMuxRole;
+
+typedef enum {
+    DBC_VALUE_INTEGER,
+    DBC_VALUE_FLOAT32,     // SIG_VALTYPE_ 1
+    DBC_VALUE_FLOAT64      // SIG_VALTYPE_ 2
+} DbcValueType;
+
+// A signal compiled down to what extracting it from a frame takes. Frames
+// are handled as one little endian 64 bit word, big endian signals work
+// on the byte swapped word, so every signal is a shift and a mask.
+typedef struct {
+    uint64_t mask;
+    uint64_t sign_bit;     // Top bit of a signed integer signal, else 0
+    int shift;
+    int big_endian;
+    DbcValueType value_type;
+    double factor;
+    double offset;
+} DbcSignalPlan;
+
+typedef struct {
+    char* name;
+    char* unit;
+    int start;             // As written in the DBC, the MSB for big endian
+    int length;
+    int little_endian;
+    int is_signed;
+    DbcValueType value_type;
+    double factor;
+    double offset;
+    DbcMuxRole mux_role;
+    int mux_value;
+    DbcSignalPlan plan;
+} DbcSignal;
+
+typedef struct {
+    uint32_t id;           // Frame ID without DBC_EXTENDED_FLAG
+    int extended;
+    char* name;
+    int dlc;
+    DbcSignal* signals;
+    int signal_count;
+    int signal_capacity;
+} DbcMessage;
+
+typedef struct {
+    DbcMessage* messages;
+    int message_count;
+    int message_capacity;
+    MappedFile* cache;     // Holds names and units when loaded from a cache
+} Dbc;
+
+// Only what decoding needs is kept: messages (BO_), their signals (SG_)
+// and float signal types (SIG_VALTYPE_). Everything else is skipped.
+Dbc* dbc_load(const char* filename);
+Dbc* dbc_parse(const char* data, size_t size);
+void dbc_free(Dbc* dbc);
+
+// 8 bytes of frame data, zero padded, as the word plans work on
+uint64_t dbc_frame_word(const uint8_t* data);
+
+// Raw bits of a signal in one frame
+uint64_t dbc_plan_raw(const DbcSignalPlan* plan, uint64_t frame);
+
+// Raw bits and physical values (raw * factor + offset) of a signal for a
+// batch of frames of its message
+void dbc_plan_extract(const DbcSignalPlan* plan, const uint64_t* frames, size_t count, uint64_t* raw);
+void dbc_plan_decode(const DbcSignalPlan* plan, const uint64_t* frames, size_t count, double* values);
+
+#endif
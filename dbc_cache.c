@@ -0,0 +1,300 @@
+#include "dbc_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char DBC_CACHE_MAGIC[8] = { 'D', 'B', 'C', 'C', 'A', 'C', 'H', 'E' };
+
+// File layout: header, signal records, message records, string table.
+// Records are stored in host layout, the magic, version and record sizes
+// reject caches built by a different build of the tool.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t signal_record_size;
+    uint64_t content_hash;
+    uint64_t content_size;
+    uint32_t message_count;
+    uint32_t signal_count;
+    uint32_t string_size;
+    uint32_t reserved;
+} DbcCacheHeader;
+
+typedef struct {
+    uint32_t name;         // Offsets into the string table
+    uint32_t unit;
+    int32_t start;
+    int32_t length;
+    int32_t little_endian;
+    int32_t is_signed;
+    int32_t value_type;
+    int32_t mux_role;
+    int32_t mux_value;
+    int32_t reserved;
+    double factor;
+    double offset;
+    DbcSignalPlan plan;
+} DbcCacheSignal;
+
+typedef struct {
+    uint32_t id;
+    int32_t extended;
+    int32_t dlc;
+    uint32_t name;
+    uint32_t first_signal;
+    uint32_t signal_count;
+} DbcCacheMessage;
+
+// FNV-1a over the whole DBC
+static uint64_t hash_content(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int valid_string(const DbcCacheHeader* header, uint32_t offset) {
+    return offset < header->string_size;
+}
+
+// Everything decoding trusts about a signal, so a stale or corrupt cache
+// that got past the header checks is rejected rather than decoded. Plans
+// are what compile_signal makes: a shift below 64, a mask of low bits and
+// a sign bit at its top, if any.
+static int valid_signal(const DbcCacheHeader* header, const DbcCacheSignal* cached) {
+    const DbcSignalPlan* plan = &cached->plan;
+    return valid_string(header, cached->name) && valid_string(header, cached->unit) &&
+        cached->value_type >= DBC_VALUE_INTEGER && cached->value_type <= DBC_VALUE_FLOAT64 &&
+        cached->mux_role >= DBC_MUX_NONE && cached->mux_role <= DBC_MUX_MULTIPLEXED &&
+        cached->length >= 0 && cached->length <= 64 &&
+        plan->value_type >= DBC_VALUE_INTEGER && plan->value_type <= DBC_VALUE_FLOAT64 &&
+        plan->shift >= 0 && plan->shift < 64 &&
+        (plan->big_endian == 0 || plan->big_endian == 1) &&
+        (plan->mask & (plan->mask + 1)) == 0 &&
+        (plan->sign_bit == 0 || plan->sign_bit == (plan->mask ^ (plan->mask >> 1)));
+}
+
+Dbc* dbc_cache_read(const char* cache_path, uint64_t content_hash, uint64_t content_size) {
+    MappedFile* map = malloc(sizeof(MappedFile));
+    if (!map) return NULL;
+    if (mapped_file_open(map, cache_path) != 0) {
+        free(map);
+        return NULL;
+    }
+
+    const DbcCacheHeader* header = (const DbcCacheHeader*)map->data;
+    size_t signals_offset = sizeof(DbcCacheHeader);
+    size_t messages_offset = 0;
+    size_t strings_offset = 0;
+    int valid = map->size >= sizeof(DbcCacheHeader) &&
+        memcmp(header->magic, DBC_CACHE_MAGIC, sizeof(DBC_CACHE_MAGIC)) == 0 &&
+        header->version == DBC_CACHE_VERSION &&
+        header->signal_record_size == sizeof(DbcCacheSignal) &&
+        header->content_hash == content_hash &&
+        header->content_size == content_size;
+
+    if (valid) {
+        messages_offset = signals_offset + (size_t)header->signal_count * sizeof(DbcCacheSignal);
+        strings_offset = messages_offset + (size_t)header->message_count * sizeof(DbcCacheMessage);
+        valid = strings_offset + header->string_size == map->size && header->string_size > 0 &&
+            map->data[map->size - 1] == '\0';
+    }
+    if (!valid) {
+        mapped_file_close(map);
+        free(map);
+        return NULL;
+    }
+
+    const DbcCacheSignal* signals = (const DbcCacheSignal*)(map->data + signals_offset);
+    const DbcCacheMessage* messages = (const DbcCacheMessage*)(map->data + messages_offset);
+    const char* strings = map->data + strings_offset;
+
+    Dbc* dbc = calloc(1, sizeof(Dbc));
+    if (!dbc) {
+        mapped_file_close(map);
+        free(map);
+        return NULL;
+    }
+    dbc->cache = map;
+    dbc->messages = calloc(header->message_count ? header->message_count : 1, sizeof(DbcMessage));
+    if (!dbc->messages) {
+        dbc_free(dbc);
+        return NULL;
+    }
+    dbc->message_capacity = (int)header->message_count;
+
+    // Names and units point straight into the mapping
+    for (uint32_t m = 0; m < header->message_count; m++) {
+        const DbcCacheMessage* record = &messages[m];
+        if (!valid_string(header, record->name) || record->first_signal > header->signal_count ||
+            record->signal_count > header->signal_count - record->first_signal ||
+            record->id > DBC_ID_MASK || (record->extended != 0 && record->extended != 1)) {
+            dbc_free(dbc);
+            return NULL;
+        }
+
+        DbcMessage* message = &dbc->messages[dbc->message_count++];
+        message->id = record->id;
+        message->extended = record->extended;
+        message->dlc = record->dlc;
+        message->name = (char*)strings + record->name;
+        message->signals = calloc(record->signal_count ? record->signal_count : 1, sizeof(DbcSignal));
+        if (!message->signals) {
+            dbc_free(dbc);
+            return NULL;
+        }
+        message->signal_capacity = (int)record->signal_count;
+
+        for (uint32_t s = 0; s < record->signal_count; s++) {
+            const DbcCacheSignal* cached = &signals[record->first_signal + s];
+            if (!valid_signal(header, cached)) {
+                dbc_free(dbc);
+                return NULL;
+            }
+
+            DbcSignal* signal = &message->signals[message->signal_count++];
+            signal->name = (char*)strings + cached->name;
+            signal->unit = (char*)strings + cached->unit;
+            signal->start = cached->start;
+            signal->length = cached->length;
+            signal->little_endian = cached->little_endian;
+            signal->is_signed = cached->is_signed;
+            signal->value_type = (DbcValueType)cached->value_type;
+            signal->factor = cached->factor;
+            signal->offset = cached->offset;
+            signal->mux_role = (DbcMuxRole)cached->mux_role;
+            signal->mux_value = cached->mux_value;
+            signal->plan = cached->plan;
+        }
+    }
+
+    return dbc;
+}
+
+static uint32_t add_string(char* table, uint32_t* size, const char* str) {
+    uint32_t offset = *size;
+    size_t len = strlen(str) + 1;
+    memcpy(table + offset, str, len);
+    *size += (uint32_t)len;
+    return offset;
+}
+
+int dbc_cache_write(const Dbc* dbc, const char* cache_path, uint64_t content_hash, uint64_t content_size) {
+    if (!dbc || !cache_path) return -1;
+
+    size_t signal_count = 0;
+    size_t string_size = 0;
+    for (int m = 0; m < dbc->message_count; m++) {
+        const DbcMessage* message = &dbc->messages[m];
+        string_size += strlen(message->name) + 1;
+        for (int s = 0; s < message->signal_count; s++) {
+            string_size += strlen(message->signals[s].name) + 1;
+            string_size += strlen(message->signals[s].unit) + 1;
+        }
+        signal_count += (size_t)message->signal_count;
+    }
+    if (string_size == 0) string_size = 1;
+    if (string_size > UINT32_MAX || signal_count > UINT32_MAX) return -1;
+
+    DbcCacheSignal* signals = calloc(signal_count ? signal_count : 1, sizeof(DbcCacheSignal));
+    DbcCacheMessage* messages = calloc(dbc->message_count ? dbc->message_count : 1, sizeof(DbcCacheMessage));
+    char* strings = calloc(string_size, 1);
+    if (!signals || !messages || !strings) {
+        free(signals);
+        free(messages);
+        free(strings);
+        return -1;
+    }
+
+    uint32_t string_fill = 0;
+    uint32_t signal_fill = 0;
+    for (int m = 0; m < dbc->message_count; m++) {
+        const DbcMessage* message = &dbc->messages[m];
+        DbcCacheMessage* record = &messages[m];
+        record->id = message->id;
+        record->extended = message->extended;
+        record->dlc = message->dlc;
+        record->name = add_string(strings, &string_fill, message->name);
+        record->first_signal = signal_fill;
+        record->signal_count = (uint32_t)message->signal_count;
+
+        for (int s = 0; s < message->signal_count; s++) {
+            const DbcSignal* signal = &message->signals[s];
+            DbcCacheSignal* cached = &signals[signal_fill++];
+            cached->name = add_string(strings, &string_fill, signal->name);
+            cached->unit = add_string(strings, &string_fill, signal->unit);
+            cached->start = signal->start;
+            cached->length = signal->length;
+            cached->little_endian = signal->little_endian;
+            cached->is_signed = signal->is_signed;
+            cached->value_type = signal->value_type;
+            cached->factor = signal->factor;
+            cached->offset = signal->offset;
+            cached->mux_role = signal->mux_role;
+            cached->mux_value = signal->mux_value;
+            cached->plan = signal->plan;
+        }
+    }
+
+    DbcCacheHeader header;
+    memset(&header, 0, sizeof(DbcCacheHeader));
+    memcpy(header.magic, DBC_CACHE_MAGIC, sizeof(DBC_CACHE_MAGIC));
+    header.version = DBC_CACHE_VERSION;
+    header.signal_record_size = sizeof(DbcCacheSignal);
+    header.content_hash = content_hash;
+    header.content_size = content_size;
+    header.message_count = (uint32_t)dbc->message_count;
+    header.signal_count = (uint32_t)signal_count;
+    header.string_size = (uint32_t)string_size;
+
+    // Written aside and renamed over the old cache, so concurrent runs
+    // never see a partial file
+    size_t path_len = strlen(cache_path) + 32;
+    char* temp_path = malloc(path_len);
+    int result = temp_path ? 0 : -1;
+    FILE* f = NULL;
+    if (result == 0) {
+        snprintf(temp_path, path_len, "%s.%ld.tmp", cache_path, (long)getpid());
+        f = fopen(temp_path, "wb");
+        if (!f) result = -1;
+    }
+
+    if (result == 0 &&
+        (fwrite(&header, sizeof(DbcCacheHeader), 1, f) != 1 ||
+         fwrite(signals, sizeof(DbcCacheSignal), signal_count, f) != signal_count ||
+         fwrite(messages, sizeof(DbcCacheMessage), (size_t)dbc->message_count, f) != (size_t)dbc->message_count ||
+         fwrite(strings, 1, string_size, f) != string_size)) {
+        result = -1;
+    }
+    if (f && fclose(f) != 0) result = -1;
+    if (result == 0 && rename(temp_path, cache_path) != 0) result = -1;
+    if (result != 0 && f) remove(temp_path);
+
+    free(temp_path);
+    free(signals);
+    free(messages);
+    free(strings);
+    return result;
+}
+
+Dbc* dbc_load_cached(const char* dbc_path, const char* cache_path) {
+    if (!cache_path) return dbc_load(dbc_path);
+
+    MappedFile source;
+    if (mapped_file_open(&source, dbc_path) != 0) return NULL;
+
+    uint64_t content_hash = hash_content(source.data, source.size);
+    Dbc* dbc = dbc_cache_read(cache_path, content_hash, source.size);
+    if (!dbc) {
+        dbc = dbc_parse(source.data, source.size);
+
+        // A cache that can't be written only costs the next run a parse
+        if (dbc) dbc_cache_write(dbc, cache_path, content_hash, source.size);
+    }
+
+    mapped_file_close(&source);
+    return dbc;
+}
@@ -0,0 +1,17 @@
+#ifndef DBC_CACHE_H
+#define DBC_CACHE_H
+
+#include "dbc.h"
+
+#define DBC_CACHE_VERSION 2
+
+// Loads a DBC through a binary cache of its parsed form. The cache holds
+// the compiled signal plans, names and units and is tagged with a hash of
+// the DBC contents; when it is missing or was built from different
+// contents the DBC is parsed and the cache rewritten.
+Dbc* dbc_load_cached(const char* dbc_path, const char* cache_path);
+
+Dbc* dbc_cache_read(const char* cache_path, uint64_t content_hash, uint64_t content_size);
+int dbc_cache_write(const Dbc* dbc, const char* cache_path, uint64_t content_hash, uint64_t content_size);
+
+#endif
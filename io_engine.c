@@ -0,0 +1,484 @@
+#include "io_engine.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define IO_ENGINE_URING 1
+#endif
+#endif
+#endif
+
+#define IO_QUEUE_DEPTH 32
+#define IO_BUFFER_COUNT 8
+#define IO_BUFFER_SIZE (1 << 20)
+#define IO_READ_SIZE (16 << 20)
+#define IO_MAX_READS (IO_QUEUE_DEPTH / 2)
+
+// One read or write in flight, requeued for the rest after a short transfer
+typedef struct IoOp {
+    int fd;
+    char* data;
+    size_t size;
+    off_t offset;
+    int buffer;            // Write buffer index or -1
+    IoRead* read;          // Read it belongs to, NULL for writes
+    struct IoOp* next_free;
+} IoOp;
+
+struct IoRead {
+    int fd;
+    char* data;
+    size_t size;
+    size_t queued;         // Bytes handed to ops so far
+    int outstanding;       // Ops in flight
+    int failed;
+    struct IoRead* next;   // Reads still being fed to the ring
+};
+
+#ifdef IO_ENGINE_URING
+typedef struct {
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    int registered;        // Write buffers registered with the ring
+} IoRing;
+#endif
+
+struct IoEngine {
+    int async;
+#ifdef IO_ENGINE_URING
+    IoRing ring;
+#endif
+    IoOp ops[IO_QUEUE_DEPTH];
+    IoOp* free_ops;
+    int in_flight;
+    int writes_in_flight;
+    int read_ops;
+    IoRead* reads;
+    char* buffer_memory;
+    int buffer_busy[IO_BUFFER_COUNT];
+    int write_failed;
+};
+
+static void complete_op(IoEngine* io, IoOp* op, ssize_t result);
+
+// Blocking transfer of a whole op, used by the fallback
+static ssize_t transfer_sync(IoOp* op) {
+    size_t done = 0;
+    while (done < op->size) {
+        ssize_t n = op->read ?
+            pread(op->fd, op->data + done, op->size - done, op->offset + (off_t)done) :
+            pwrite(op->fd, op->data + done, op->size - done, op->offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -errno;
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+#ifdef IO_ENGINE_URING
+static int ring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    for (;;) {
+        long n = syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+        if (n >= 0 || errno != EINTR) return (int)n;
+    }
+}
+
+static int ring_setup(IoRing* ring, char* buffers) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(IoRing));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+    if (ring->fd < 0) return -1;
+
+    // Plain READ and WRITE ops arrived in the same kernel as this feature
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return -1;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    char* sq = (char*)ring->sq_ring;
+    char* cq = (char*)ring->cq_ring;
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Registered buffers skip pinning pages on every write, without them
+    // (e.g. over the locked memory limit) plain writes still work
+    struct iovec iov[IO_BUFFER_COUNT];
+    for (int i = 0; i < IO_BUFFER_COUNT; i++) {
+        iov[i].iov_base = buffers + (size_t)i * IO_BUFFER_SIZE;
+        iov[i].iov_len = IO_BUFFER_SIZE;
+    }
+    ring->registered = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                               iov, IO_BUFFER_COUNT) == 0;
+    return 0;
+}
+
+static void ring_close(IoRing* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// The ring has as many entries as there are ops, so there is always room
+static int ring_submit(IoRing* ring, IoOp* op) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    if (op->read) {
+        sqe->opcode = IORING_OP_READ;
+    } else if (op->buffer >= 0 && ring->registered) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = (unsigned short)op->buffer;
+    } else {
+        sqe->opcode = IORING_OP_WRITE;
+    }
+    sqe->fd = op->fd;
+    sqe->addr = (unsigned long)op->data;
+    sqe->len = (unsigned)op->size;
+    sqe->off = (unsigned long long)op->offset;
+    sqe->user_data = (unsigned long long)(uintptr_t)op;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (ring_enter(ring->fd, 1, 0, 0) != 1) {
+        // Not consumed, take it back out
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 0;
+}
+
+// Handles every completion there is, waiting for one if there are none.
+// Completions may submit more ops but never reap, so the head is only
+// ever moved here.
+static int ring_reap(IoEngine* io) {
+    IoRing* ring = &io->ring;
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) &&
+        ring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+        return -1;
+    }
+
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        IoOp* op = (IoOp*)(uintptr_t)cqe->user_data;
+        ssize_t result = cqe->res;
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        complete_op(io, op, result);
+    }
+    return 0;
+}
+#endif
+
+static void submit_op(IoEngine* io, IoOp* op) {
+    io->in_flight++;
+    if (op->read) {
+        io->read_ops++;
+    } else {
+        io->writes_in_flight++;
+    }
+
+#ifdef IO_ENGINE_URING
+    if (io->async) {
+        if (ring_submit(&io->ring, op) != 0) complete_op(io, op, -EIO);
+        return;
+    }
+#endif
+    complete_op(io, op, transfer_sync(op));
+}
+
+// Waits for one completion, 0 if nothing is in flight
+static int wait_one(IoEngine* io) {
+    if (io->in_flight == 0) return 0;
+#ifdef IO_ENGINE_URING
+    if (io->async) return ring_reap(io) == 0 ? 1 : -1;
+#endif
+    return 0;
+}
+
+static IoOp* acquire_op(IoEngine* io) {
+    while (!io->free_ops) {
+        if (wait_one(io) <= 0) return NULL;
+    }
+    IoOp* op = io->free_ops;
+    io->free_ops = op->next_free;
+    return op;
+}
+
+static void feed_reads(IoEngine* io);
+
+static void complete_op(IoEngine* io, IoOp* op, ssize_t result) {
+    io->in_flight--;
+    if (op->read) {
+        io->read_ops--;
+    } else {
+        io->writes_in_flight--;
+    }
+
+    if (result > 0 && (size_t)result < op->size) {
+        // Short transfer, the op goes back in for the rest
+        op->data += result;
+        op->offset += result;
+        op->size -= (size_t)result;
+        submit_op(io, op);
+        return;
+    }
+
+    // A read that comes back empty means the file shrank under us
+    if (result < 0 || (result == 0 && op->size > 0)) {
+        if (op->read) {
+            op->read->failed = 1;
+        } else {
+            io->write_failed = 1;
+        }
+    }
+
+    if (op->read) op->read->outstanding--;
+    if (op->buffer >= 0) io->buffer_busy[op->buffer] = 0;
+    op->next_free = io->free_ops;
+    io->free_ops = op;
+
+    // Blocking reads are fed by the loop that started them
+    if (op->read && io->async) feed_reads(io);
+}
+
+// Hands the unread parts of the pending reads to the ring, reads never take
+// more than half the ops so writes keep flowing
+static void feed_reads(IoEngine* io) {
+    for (IoRead* read = io->reads; read; read = read->next) {
+        while (!read->failed && read->queued < read->size &&
+               io->read_ops < IO_MAX_READS && io->free_ops) {
+            IoOp* op = io->free_ops;
+            io->free_ops = op->next_free;
+
+            size_t size = read->size - read->queued;
+            if (size > IO_READ_SIZE) size = IO_READ_SIZE;
+            op->fd = read->fd;
+            op->data = read->data + read->queued;
+            op->size = size;
+            op->offset = (off_t)read->queued;
+            op->buffer = -1;
+            op->read = read;
+            read->queued += size;
+            read->outstanding++;
+            submit_op(io, op);
+        }
+    }
+}
+
+IoEngine* io_engine_create(void) {
+    IoEngine* io = calloc(1, sizeof(IoEngine));
+    if (!io) return NULL;
+
+    io->buffer_memory = malloc((size_t)IO_BUFFER_COUNT * IO_BUFFER_SIZE);
+    if (!io->buffer_memory) {
+        free(io);
+        return NULL;
+    }
+
+    for (int i = IO_QUEUE_DEPTH - 1; i >= 0; i--) {
+        io->ops[i].next_free = io->free_ops;
+        io->free_ops = &io->ops[i];
+    }
+
+#ifdef IO_ENGINE_URING
+    io->async = ring_setup(&io->ring, io->buffer_memory) == 0;
+#endif
+    return io;
+}
+
+void io_engine_destroy(IoEngine* io) {
+    if (!io) return;
+
+    // Nothing may still point at the buffers when they go
+    while (io->in_flight > 0 && wait_one(io) > 0) {
+    }
+#ifdef IO_ENGINE_URING
+    if (io->async) ring_close(&io->ring);
+#endif
+    free(io->buffer_memory);
+    free(io);
+}
+
+int io_engine_is_async(const IoEngine* io) {
+    return io && io->async;
+}
+
+IoRead* io_engine_start_read(IoEngine* io, const char* path) {
+    if (!io || !path) return NULL;
+
+    IoRead* read = calloc(1, sizeof(IoRead));
+    if (!read) return NULL;
+
+    read->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (read->fd < 0 || fstat(read->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (read->fd >= 0) close(read->fd);
+        free(read);
+        return NULL;
+    }
+
+    read->size = (size_t)st.st_size;
+    read->data = malloc(read->size ? read->size : 1);
+    if (!read->data) {
+        close(read->fd);
+        free(read);
+        return NULL;
+    }
+
+    read->next = io->reads;
+    io->reads = read;
+    feed_reads(io);
+    return read;
+}
+
+int io_engine_finish_read(IoEngine* io, IoRead* read, MappedFile* map) {
+    if (!io || !read || !map) return -1;
+
+    while (read->outstanding > 0 || (!read->failed && read->queued < read->size)) {
+        feed_reads(io);
+
+        // Should waiting ever fail the kernel may still write into the
+        // buffer, so it is left alone rather than freed
+        if (read->outstanding > 0 && wait_one(io) < 0) return -1;
+    }
+
+    IoRead** link = &io->reads;
+    while (*link != read) link = &(*link)->next;
+    *link = read->next;
+    close(read->fd);
+
+    int result = read->failed ? -1 : 0;
+    if (result == 0) {
+        memset(map, 0, sizeof(MappedFile));
+        map->base = read->data;
+        map->base_size = read->size;
+        map->data = read->data;
+        map->size = read->size;
+        map->is_mapped = 0;
+    } else {
+        free(read->data);
+    }
+    free(read);
+    return result;
+}
+
+char* io_engine_buffer(IoEngine* io, int* index, size_t* size) {
+    if (!io || !index || !size) return NULL;
+
+    for (;;) {
+        for (int i = 0; i < IO_BUFFER_COUNT; i++) {
+            if (!io->buffer_busy[i]) {
+                io->buffer_busy[i] = 1;
+                *index = i;
+                *size = IO_BUFFER_SIZE;
+                return io->buffer_memory + (size_t)i * IO_BUFFER_SIZE;
+            }
+        }
+        if (wait_one(io) <= 0) return NULL;
+    }
+}
+
+int io_engine_write_buffer(IoEngine* io, int index, int fd, size_t size, off_t offset) {
+    if (!io || index < 0 || index >= IO_BUFFER_COUNT || size > IO_BUFFER_SIZE) return -1;
+
+    IoOp* op = acquire_op(io);
+    if (!op) {
+        io->buffer_busy[index] = 0;
+        return -1;
+    }
+
+    op->fd = fd;
+    op->data = io->buffer_memory + (size_t)index * IO_BUFFER_SIZE;
+    op->size = size;
+    op->offset = offset;
+    op->buffer = index;
+    op->read = NULL;
+    submit_op(io, op);
+    return 0;
+}
+
+int io_engine_flush(IoEngine* io) {
+    if (!io) return -1;
+
+    while (io->writes_in_flight > 0) {
+        if (wait_one(io) <= 0) break;
+    }
+
+    int result = io->write_failed || io->writes_in_flight > 0 ? -1 : 0;
+    io->write_failed = 0;
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "mapped_file.h"
+
+// Asynchronous file I/O through io_uring, driven with raw syscalls so there
+// is no liburing dependency. Writes go out of a small set of registered
+// buffers: the caller fills one, queues it and carries on with the next
+// while the kernel writes. Whole file reads are started early and collected
+// later so reading overlaps other work. Where io_uring isn't available
+// (older kernels, other systems, sandboxes) the same calls fall back to
+// blocking pread/pwrite.
+//
+// What overlaps is a file's encoding with its own writes, and the read of a
+// batch's next log with the conversion of the current one. motec_log_write
+// flushes before it returns, so at most the last IO_BUFFER_COUNT buffers of
+// a file (8 MiB) are written while nothing else runs. The next log is not
+// parsed while they drain, because a write error has to be reported against
+// the file it belongs to.
+//
+// An engine belongs to one thread.
+typedef struct IoEngine IoEngine;
+typedef struct IoRead IoRead;
+
+IoEngine* io_engine_create(void);
+void io_engine_destroy(IoEngine* io);
+int io_engine_is_async(const IoEngine* io);
+
+// Starts reading a whole file, NULL if it can't be opened
+IoRead* io_engine_start_read(IoEngine* io, const char* path);
+
+// Waits for a read and hands its contents over as a heap backed MappedFile.
+// The read is freed either way.
+int io_engine_finish_read(IoEngine* io, IoRead* read, MappedFile* map);
+
+// A free write buffer of *size bytes, waits for a write to finish if all
+// of them are queued
+char* io_engine_buffer(IoEngine* io, int* index, size_t* size);
+
+// Queues size bytes of buffer index for writing at offset. The buffer is
+// free again once the write is done.
+int io_engine_write_buffer(IoEngine* io, int index, int fd, size_t size, off_t offset);
+
+// Waits for every queued write, -1 if any of them failed since the last flush
+int io_engine_flush(IoEngine* io);
+
+#endif
@@ -0,0 +1,673 @@
+#include "ld_codec.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Largest distance from an integer a scaled value may have and still count
+// as exact, absorbs the rounding of parsing "0.1" into a double
+#define QUANT_TOLERANCE 1e-6
+#define MAX_DECIMALS 9
+#define HALF_MAX 65504.0
+#define CODEC_BLOCK_SIZE 1024
+
+uint16_t ld_float_to_half(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exp = (x >> 23) & 0xff;
+    uint32_t mant = x & 0x7fffff;
+
+    // Inf stays inf, NaN stays a quiet NaN with the top payload bits
+    if (exp == 0xff) return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 | (mant >> 13) : 0));
+
+    int e = (int)exp - 127 + 15;
+    if (e >= 31) return (uint16_t)(sign | 0x7c00);
+
+    if (e <= 0) {
+        // Subnormal or zero, everything below half the smallest subnormal
+        // rounds to zero
+        if (e < -10) return (uint16_t)sign;
+        mant |= 0x800000;
+        int shift = 14 - e;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1))) h++;
+        return (uint16_t)(sign | h);
+    }
+
+    // Rounding may carry into the exponent, up to inf
+    uint32_t h = ((uint32_t)e << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+    return (uint16_t)(sign | h);
+}
+
+float ld_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exp = (half >> 10) & 0x1f;
+    uint32_t mant = half & 0x3ff;
+    uint32_t x;
+
+    if (exp == 0x1f) {
+        x = sign | 0x7f800000 | (mant << 13);
+    } else if (exp == 0) {
+        // Subnormals are exact in single precision
+        float value = (float)mant * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    } else {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+static void encode_float32_scalar(float* dst, const double* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (float)src[i];
+    }
+}
+
+static void encode_float16_scalar(uint16_t* dst, const double* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = ld_float_to_half((float)src[i]);
+    }
+}
+
+static void encode_int16_scalar(int16_t* dst, const double* src, size_t count,
+                                double shift, double factor) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int16_t)nearbyint((src[i] - shift) * factor);
+    }
+}
+
+static void encode_int32_scalar(int32_t* dst, const double* src, size_t count,
+                                double shift, double factor) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int32_t)nearbyint((src[i] - shift) * factor);
+    }
+}
+
+// Range and largest distance of value * factor from the nearest integer.
+// Any inf or NaN leaves min or max NaN.
+static void scan_scalar(const double* src, size_t count, double factor,
+                        double* min, double* max, double* residual) {
+    double lo = src[0];
+    double hi = src[0];
+    double worst = 0.0;
+    double poison = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        double v = src[i];
+        double q = v * factor;
+        double r = fabs(q - nearbyint(q));
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        worst = r > worst ? r : worst;
+        poison += v * 0.0;
+    }
+
+    *min = lo + poison;
+    *max = hi + poison;
+    *residual = worst;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// cvtpd2ps and cvtpd2dq round with the current rounding mode, the same as
+// the cast and nearbyint in the scalar versions
+static void encode_float32_sse2(float* dst, const double* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+    encode_float32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx")))
+static void encode_float32_avx(float* dst, const double* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+        _mm_storeu_ps(dst + i, lo);
+        _mm_storeu_ps(dst + i + 4, hi);
+    }
+    encode_float32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void encode_float16_f16c(uint16_t* dst, const double* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+        __m128i half = _mm256_cvtps_ph(_mm256_set_m128(hi, lo), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), half);
+    }
+    encode_float16_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx")))
+static void encode_int16_avx(int16_t* dst, const double* src, size_t count,
+                             double shift, double factor) {
+    const __m256d s = _mm256_set1_pd(shift);
+    const __m256d f = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = _mm256_cvtpd_epi32(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(src + i), s), f));
+        __m128i hi = _mm256_cvtpd_epi32(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(src + i + 4), s), f));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    encode_int16_scalar(dst + i, src + i, count - i, shift, factor);
+}
+
+__attribute__((target("avx")))
+static void encode_int32_avx(int32_t* dst, const double* src, size_t count,
+                             double shift, double factor) {
+    const __m256d s = _mm256_set1_pd(shift);
+    const __m256d f = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i q = _mm256_cvtpd_epi32(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(src + i), s), f));
+        _mm_storeu_si128((__m128i*)(dst + i), q);
+    }
+    encode_int32_scalar(dst + i, src + i, count - i, shift, factor);
+}
+
+__attribute__((target("avx")))
+static void scan_avx(const double* src, size_t count, double factor,
+                     double* min, double* max, double* residual) {
+    if (count < 4) {
+        scan_scalar(src, count, factor, min, max, residual);
+        return;
+    }
+
+    const __m256d f = _mm256_set1_pd(factor);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    __m256d lo = _mm256_loadu_pd(src);
+    __m256d hi = lo;
+    __m256d worst = zero;
+    __m256d poison = zero;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d v = _mm256_loadu_pd(src + i);
+        __m256d q = _mm256_mul_pd(v, f);
+        __m256d r = _mm256_sub_pd(q, _mm256_round_pd(q, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        lo = _mm256_min_pd(lo, v);
+        hi = _mm256_max_pd(hi, v);
+        worst = _mm256_max_pd(worst, _mm256_and_pd(r, abs_mask));
+        poison = _mm256_add_pd(poison, _mm256_mul_pd(v, zero));
+    }
+
+    double l[4], h[4], w[4], p[4];
+    _mm256_storeu_pd(l, lo);
+    _mm256_storeu_pd(h, hi);
+    _mm256_storeu_pd(w, worst);
+    _mm256_storeu_pd(p, poison);
+
+    double lo_all = l[0];
+    double hi_all = h[0];
+    double worst_all = 0.0;
+    double poison_all = 0.0;
+    for (int k = 0; k < 4; k++) {
+        lo_all = l[k] < lo_all ? l[k] : lo_all;
+        hi_all = h[k] > hi_all ? h[k] : hi_all;
+        worst_all = w[k] > worst_all ? w[k] : worst_all;
+        poison_all += p[k];
+    }
+
+    for (; i < count; i++) {
+        double v = src[i];
+        double q = v * factor;
+        double r = fabs(q - nearbyint(q));
+        lo_all = v < lo_all ? v : lo_all;
+        hi_all = v > hi_all ? v : hi_all;
+        worst_all = r > worst_all ? r : worst_all;
+        poison_all += v * 0.0;
+    }
+
+    *min = lo_all + poison_all;
+    *max = hi_all + poison_all;
+    *residual = worst_all;
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+static void encode_float32_neon(float* dst, const double* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x2_t lo = vcvt_f32_f64(vld1q_f64(src + i));
+        float32x4_t both = vcvt_high_f32_f64(lo, vld1q_f64(src + i + 2));
+        vst1q_f32(dst + i, both);
+    }
+    encode_float32_scalar(dst + i, src + i, count - i);
+}
+
+static void encode_float16_neon(uint16_t* dst, const double* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x2_t lo = vcvt_f32_f64(vld1q_f64(src + i));
+        float32x4_t both = vcvt_high_f32_f64(lo, vld1q_f64(src + i + 2));
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(both)));
+    }
+    encode_float16_scalar(dst + i, src + i, count - i);
+}
+
+// fcvtns rounds to nearest even like nearbyint, the narrowing saturates
+static void encode_int16_neon(int16_t* dst, const double* src, size_t count,
+                              double shift, double factor) {
+    const float64x2_t s = vdupq_n_f64(shift);
+    const float64x2_t f = vdupq_n_f64(factor);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int64x2_t a = vcvtnq_s64_f64(vmulq_f64(vsubq_f64(vld1q_f64(src + i), s), f));
+        int64x2_t b = vcvtnq_s64_f64(vmulq_f64(vsubq_f64(vld1q_f64(src + i + 2), s), f));
+        int32x4_t q = vcombine_s32(vqmovn_s64(a), vqmovn_s64(b));
+        vst1_s16(dst + i, vqmovn_s32(q));
+    }
+    encode_int16_scalar(dst + i, src + i, count - i, shift, factor);
+}
+
+static void encode_int32_neon(int32_t* dst, const double* src, size_t count,
+                              double shift, double factor) {
+    const float64x2_t s = vdupq_n_f64(shift);
+    const float64x2_t f = vdupq_n_f64(factor);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int64x2_t a = vcvtnq_s64_f64(vmulq_f64(vsubq_f64(vld1q_f64(src + i), s), f));
+        int64x2_t b = vcvtnq_s64_f64(vmulq_f64(vsubq_f64(vld1q_f64(src + i + 2), s), f));
+        vst1q_s32(dst + i, vcombine_s32(vqmovn_s64(a), vqmovn_s64(b)));
+    }
+    encode_int32_scalar(dst + i, src + i, count - i, shift, factor);
+}
+#endif
+
+void ld_encode_float32(float* dst, const double* src, size_t count) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+        encode_float32_avx(dst, src, count);
+        return;
+    }
+    encode_float32_sse2(dst, src, count);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    encode_float32_neon(dst, src, count);
+#else
+    encode_float32_scalar(dst, src, count);
+#endif
+}
+
+void ld_encode_float16(uint16_t* dst, const double* src, size_t count) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+        encode_float16_f16c(dst, src, count);
+        return;
+    }
+    encode_float16_scalar(dst, src, count);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    encode_float16_neon(dst, src, count);
+#else
+    encode_float16_scalar(dst, src, count);
+#endif
+}
+
+void ld_encode_int16(int16_t* dst, const double* src, size_t count, double shift, double factor) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+        encode_int16_avx(dst, src, count, shift, factor);
+        return;
+    }
+    encode_int16_scalar(dst, src, count, shift, factor);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    encode_int16_neon(dst, src, count, shift, factor);
+#else
+    encode_int16_scalar(dst, src, count, shift, factor);
+#endif
+}
+
+void ld_encode_int32(int32_t* dst, const double* src, size_t count, double shift, double factor) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+        encode_int32_avx(dst, src, count, shift, factor);
+        return;
+    }
+    encode_int32_scalar(dst, src, count, shift, factor);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    encode_int32_neon(dst, src, count, shift, factor);
+#else
+    encode_int32_scalar(dst, src, count, shift, factor);
+#endif
+}
+
+static void scan_values(const double* src, size_t count, double factor,
+                        double* min, double* max, double* residual) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+        scan_avx(src, count, factor, min, max, residual);
+        return;
+    }
+#endif
+    scan_scalar(src, count, factor, min, max, residual);
+}
+
+size_t ld_encoding_size(const LdEncoding* enc) {
+    return (enc->dtype == DTYPE_FLOAT16 || enc->dtype == DTYPE_INT16) ? 2 : 4;
+}
+
+static double pow10i(int n) {
+    double value = 1.0;
+    while (n-- > 0) value *= 10.0;
+    return value;
+}
+
+void ld_encode(void* dst, const double* src, size_t count, const LdEncoding* enc) {
+    double factor = pow10i(enc->dec) * enc->scale / enc->mul;
+
+    switch (enc->dtype) {
+        case DTYPE_FLOAT16:
+            ld_encode_float16((uint16_t*)dst, src, count);
+            break;
+        case DTYPE_INT16:
+            ld_encode_int16((int16_t*)dst, src, count, enc->shift, factor);
+            break;
+        case DTYPE_INT32:
+            ld_encode_int32((int32_t*)dst, src, count, enc->shift, factor);
+            break;
+        default:
+            ld_encode_float32((float*)dst, src, count);
+            break;
+    }
+}
+
+// Largest difference between the values and their half precision round trip
+static double float16_error(const double* src, size_t count) {
+    uint16_t half[CODEC_BLOCK_SIZE];
+    double worst = 0.0;
+
+    for (size_t first = 0; first < count; first += CODEC_BLOCK_SIZE) {
+        size_t n = count - first < CODEC_BLOCK_SIZE ? count - first : CODEC_BLOCK_SIZE;
+        ld_encode_float16(half, src + first, n);
+        for (size_t i = 0; i < n; i++) {
+            double error = fabs((double)ld_half_to_float(half[i]) - src[first + i]);
+            if (error > worst) worst = error;
+        }
+    }
+    return worst;
+}
+
+// Integer shift that centres the range, if the raw values need one to fit
+static int fits_integer(double min, double max, double factor, double limit, int* shift) {
+    if (nearbyint(min * factor) >= -limit - 1 && nearbyint(max * factor) <= limit) {
+        *shift = 0;
+        return 1;
+    }
+
+    double mid = nearbyint(0.5 * (min + max));
+    if (mid < INT16_MIN || mid > INT16_MAX) return 0;
+    if (nearbyint((min - mid) * factor) >= -limit - 1 && nearbyint((max - mid) * factor) <= limit) {
+        *shift = (int)mid;
+        return 1;
+    }
+    return 0;
+}
+
+void ld_choose_encoding(const double* values, size_t count, int decimals,
+                        double max_error, LdEncoding* enc) {
+    enc->dtype = DTYPE_FLOAT32;
+    enc->shift = 0;
+    enc->mul = 1;
+    enc->scale = 1;
+    enc->dec = 0;
+    if (count == 0) return;
+
+    if (decimals < 0) decimals = 0;
+    if (decimals > MAX_DECIMALS) decimals = MAX_DECIMALS;
+
+    double min, max, residual;
+    double factor = pow10i(decimals);
+    scan_values(values, count, factor, &min, &max, &residual);
+    if (isnan(min) || isnan(max)) return;
+
+    int dec = decimals;
+    int exact = residual <= QUANT_TOLERANCE;
+    if (max_error > 0.0) {
+        // Fewest decimals whose rounding stays within the bound
+        int bounded = 0;
+        while (bounded < MAX_DECIMALS && 0.5 / pow10i(bounded) > max_error) bounded++;
+        if (!exact || bounded < dec) dec = bounded;
+    } else if (!exact) {
+        return;
+    }
+    factor = pow10i(dec);
+
+    int shift;
+    if (fits_integer(min, max, factor, INT16_MAX, &shift)) {
+        enc->dtype = DTYPE_INT16;
+    } else if (max_error > 0.0 && fabs(min) <= HALF_MAX && fabs(max) <= HALF_MAX &&
+               float16_error(values, count) <= max_error) {
+        enc->dtype = DTYPE_FLOAT16;
+        return;
+    } else if (fits_integer(min, max, factor, INT32_MAX, &shift)) {
+        enc->dtype = DTYPE_INT32;
+    } else {
+        return;
+    }
+
+    enc->shift = shift;
+    enc->dec = dec;
+}
+
+// Decoding, raw samples to calibrated values. Every type is widened to
+// double, calibrated as (raw * factor + shift) * mul with factor hoisted out
+// of the loop, and narrowed to float only at the end.
+
+typedef struct {
+    double factor;      // 10^-dec / scale
+    double shift;
+    double mul;
+} Calibration;
+
+static inline double calibrate(double raw, const Calibration* cal) {
+    double value = raw * cal->factor + cal->shift;
+    return value * cal->mul;
+}
+
+// The scalar kernels load through memcpy, samples in a file from another
+// writer may sit at any offset
+static void decode_float32_scalar(double* dst, const void* src, size_t count, const Calibration* cal) {
+    const char* p = src;
+    for (size_t i = 0; i < count; i++) {
+        float raw;
+        memcpy(&raw, p + i * sizeof(raw), sizeof(raw));
+        dst[i] = calibrate(raw, cal);
+    }
+}
+
+static void decode_float16_scalar(double* dst, const void* src, size_t count, const Calibration* cal) {
+    const char* p = src;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t raw;
+        memcpy(&raw, p + i * sizeof(raw), sizeof(raw));
+        dst[i] = calibrate(ld_half_to_float(raw), cal);
+    }
+}
+
+static void decode_int16_scalar(double* dst, const void* src, size_t count, const Calibration* cal) {
+    const char* p = src;
+    for (size_t i = 0; i < count; i++) {
+        int16_t raw;
+        memcpy(&raw, p + i * sizeof(raw), sizeof(raw));
+        dst[i] = calibrate(raw, cal);
+    }
+}
+
+static void decode_int32_scalar(double* dst, const void* src, size_t count, const Calibration* cal) {
+    const char* p = src;
+    for (size_t i = 0; i < count; i++) {
+        int32_t raw;
+        memcpy(&raw, p + i * sizeof(raw), sizeof(raw));
+        dst[i] = calibrate(raw, cal);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx")))
+static inline __m256d calibrate_avx(__m256d raw, const Calibration* cal) {
+    __m256d value = _mm256_add_pd(_mm256_mul_pd(raw, _mm256_set1_pd(cal->factor)),
+                                  _mm256_set1_pd(cal->shift));
+    return _mm256_mul_pd(value, _mm256_set1_pd(cal->mul));
+}
+
+__attribute__((target("avx")))
+static void decode_float32_avx(double* dst, const float* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d raw = _mm256_cvtps_pd(_mm_loadu_ps(src + i));
+        _mm256_storeu_pd(dst + i, calibrate_avx(raw, cal));
+    }
+    decode_float32_scalar(dst + i, src + i, count - i, cal);
+}
+
+__attribute__((target("avx,f16c")))
+static void decode_float16_f16c(double* dst, const uint16_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 half = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm256_storeu_pd(dst + i, calibrate_avx(_mm256_cvtps_pd(half), cal));
+    }
+    decode_float16_scalar(dst + i, src + i, count - i, cal);
+}
+
+__attribute__((target("avx")))
+static void decode_int16_avx(double* dst, const int16_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i wide = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm256_storeu_pd(dst + i, calibrate_avx(_mm256_cvtepi32_pd(wide), cal));
+    }
+    decode_int16_scalar(dst + i, src + i, count - i, cal);
+}
+
+__attribute__((target("avx")))
+static void decode_int32_avx(double* dst, const int32_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i raw = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm256_storeu_pd(dst + i, calibrate_avx(_mm256_cvtepi32_pd(raw), cal));
+    }
+    decode_int32_scalar(dst + i, src + i, count - i, cal);
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+// Byte loads reinterpreted, the samples need not be aligned to their type
+static inline float64x2_t calibrate_neon(float64x2_t raw, const Calibration* cal) {
+    float64x2_t value = vaddq_f64(vmulq_f64(raw, vdupq_n_f64(cal->factor)), vdupq_n_f64(cal->shift));
+    return vmulq_f64(value, vdupq_n_f64(cal->mul));
+}
+
+static inline void store_calibrated_neon(double* dst, float32x4_t raw, const Calibration* cal) {
+    vst1q_f64(dst, calibrate_neon(vcvt_f64_f32(vget_low_f32(raw)), cal));
+    vst1q_f64(dst + 2, calibrate_neon(vcvt_high_f64_f32(raw), cal));
+}
+
+static void decode_float32_neon(double* dst, const float* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        store_calibrated_neon(dst + i, vreinterpretq_f32_u8(vld1q_u8((const uint8_t*)(src + i))), cal);
+    }
+    decode_float32_scalar(dst + i, src + i, count - i, cal);
+}
+
+static void decode_float16_neon(double* dst, const uint16_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t raw = vcvt_f32_f16(vreinterpret_f16_u16(vreinterpret_u16_u8(vld1_u8((const uint8_t*)(src + i)))));
+        store_calibrated_neon(dst + i, raw, cal);
+    }
+    decode_float16_scalar(dst + i, src + i, count - i, cal);
+}
+
+static void decode_int16_neon(double* dst, const int16_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t wide = vmovl_s16(vreinterpret_s16_u8(vld1_u8((const uint8_t*)(src + i))));
+        vst1q_f64(dst + i, calibrate_neon(vcvtq_f64_s64(vmovl_s32(vget_low_s32(wide))), cal));
+        vst1q_f64(dst + i + 2, calibrate_neon(vcvtq_f64_s64(vmovl_high_s32(wide)), cal));
+    }
+    decode_int16_scalar(dst + i, src + i, count - i, cal);
+}
+
+static void decode_int32_neon(double* dst, const int32_t* src, size_t count, const Calibration* cal) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t raw = vreinterpretq_s32_u8(vld1q_u8((const uint8_t*)(src + i)));
+        vst1q_f64(dst + i, calibrate_neon(vcvtq_f64_s64(vmovl_s32(vget_low_s32(raw))), cal));
+        vst1q_f64(dst + i + 2, calibrate_neon(vcvtq_f64_s64(vmovl_high_s32(raw)), cal));
+    }
+    decode_int32_scalar(dst + i, src + i, count - i, cal);
+}
+#endif
+
+void ld_decode_double(double* dst, const void* src, size_t count, const LdEncoding* enc) {
+    Calibration cal;
+    cal.factor = pow(10, -enc->dec) / enc->scale;
+    cal.shift = enc->shift;
+    cal.mul = enc->mul;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+        switch (enc->dtype) {
+            case DTYPE_FLOAT16:
+                if (__builtin_cpu_supports("f16c")) {
+                    decode_float16_f16c(dst, src, count, &cal);
+                } else {
+                    decode_float16_scalar(dst, src, count, &cal);
+                }
+                return;
+            case DTYPE_INT16: decode_int16_avx(dst, src, count, &cal); return;
+            case DTYPE_INT32: decode_int32_avx(dst, src, count, &cal); return;
+            default: decode_float32_avx(dst, src, count, &cal); return;
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    switch (enc->dtype) {
+        case DTYPE_FLOAT16: decode_float16_neon(dst, src, count, &cal); return;
+        case DTYPE_INT16: decode_int16_neon(dst, src, count, &cal); return;
+        case DTYPE_INT32: decode_int32_neon(dst, src, count, &cal); return;
+        default: decode_float32_neon(dst, src, count, &cal); return;
+    }
+#endif
+
+    switch (enc->dtype) {
+        case DTYPE_FLOAT16: decode_float16_scalar(dst, src, count, &cal); break;
+        case DTYPE_INT16: decode_int16_scalar(dst, src, count, &cal); break;
+        case DTYPE_INT32: decode_int32_scalar(dst, src, count, &cal); break;
+        default: decode_float32_scalar(dst, src, count, &cal); break;
+    }
+}
+
+void ld_decode_float(float* dst, const void* src, size_t count, const LdEncoding* enc) {
+    // Uncalibrated float32 is already the answer
+    if (enc->dtype == DTYPE_FLOAT32 && enc->shift == 0 && enc->mul == 1 &&
+        enc->scale == 1 && enc->dec == 0) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+
+    // Through a cache sized block of doubles so each sample is calibrated
+    // at full precision and rounded once
+    double block[CODEC_BLOCK_SIZE];
+    size_t size = ld_encoding_size(enc);
+    for (size_t first = 0; first < count; first += CODEC_BLOCK_SIZE) {
+        size_t n = count - first < CODEC_BLOCK_SIZE ? count - first : CODEC_BLOCK_SIZE;
+        ld_decode_double(block, (const char*)src + first * size, n, enc);
+        ld_encode_float32(dst + first, block, n);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef LD_CODEC_H
+#define LD_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ldparser.h"
+
+// Sample conversions between DataLog values and the .ld channel encodings.
+// Every kernel has SIMD versions picked at runtime and gives exactly the same
+// result as the plain C conversion.
+
+// How a channel's samples are stored. A raw sample decodes as
+// (raw / scale * 10^-dec + shift) * mul.
+typedef struct {
+    DataType dtype;
+    int shift;
+    int mul;
+    int scale;
+    int dec;
+} LdEncoding;
+
+// dst[i] = (float)src[i], rounded to nearest like the C cast
+void ld_encode_float32(float* dst, const double* src, size_t count);
+
+// IEEE half precision of (float)src[i], rounded to nearest even
+void ld_encode_float16(uint16_t* dst, const double* src, size_t count);
+
+// dst[i] = round_even((src[i] - shift) * factor), callers make sure the
+// results are in range
+void ld_encode_int16(int16_t* dst, const double* src, size_t count, double shift, double factor);
+void ld_encode_int32(int32_t* dst, const double* src, size_t count, double shift, double factor);
+
+// Encodes count samples to dst with the given encoding, dst holds
+// count * ld_encoding_size(enc) bytes
+void ld_encode(void* dst, const double* src, size_t count, const LdEncoding* enc);
+size_t ld_encoding_size(const LdEncoding* enc);
+
+// Picks the smallest encoding that reproduces every value. With decimals
+// known, values are exact once scaled by 10^decimals. A max_error above 0
+// allows any encoding whose decoded values stay within max_error instead.
+// Channels nothing smaller fits stay float32.
+void ld_choose_encoding(const double* values, size_t count, int decimals,
+                        double max_error, LdEncoding* enc);
+
+// Calibrated values of count raw samples stored with the given encoding.
+// A scale of 0 is the caller's to reject.
+void ld_decode_double(double* dst, const void* src, size_t count, const LdEncoding* enc);
+void ld_decode_float(float* dst, const void* src, size_t count, const LdEncoding* enc);
+
+// Scalar half precision conversions, exact in both directions
+uint16_t ld_float_to_half(float value);
+float ld_half_to_float(uint16_t half);
+
+#endif
@@ -1,6 +1,12 @@
 #include "ldparser.h"
+#include "ld_codec.h"
 #include <stdint.h>
-#include <math.h>
+#include <sys/mman.h>
+
+#define INITIAL_CHANNEL_CAPACITY 64
+
+// Bytes of one channel's metadata record on disk
+#define CHANNEL_RECORD_SIZE 82
 
 // Helper function to decode strings (remove trailing zeros)
 static void decode_string(char* dest, const char* src, size_t max_len) {
@@ -14,60 +20,80 @@ static void decode_string(char* dest, const char* src, size_t max_len) {
     }
 }
 
-// Read channel data
-static void* read_channel_data(FILE* f, LDChannel* chan) {
-    void* data = NULL;
-    size_t element_size;
-    
-    switch(chan->dtype) {
-        case DTYPE_FLOAT32:
-            element_size = sizeof(float);
-            break;
-        case DTYPE_INT32:
-            element_size = sizeof(int32_t);
-            break;
-        case DTYPE_FLOAT16:
-        case DTYPE_INT16:
-            element_size = sizeof(int16_t);
-            break;
-        default:
-            return NULL;
-    }
-    
-    data = malloc(chan->data_len * element_size);
-    if (!data) return NULL;
-    
-    fseek(f, chan->data_ptr, SEEK_SET);
-    fread(data, element_size, chan->data_len, f);
-    
-    // Apply scaling factors
-    if (chan->dtype == DTYPE_FLOAT32) {
-        float* fdata = (float*)data;
-        for (int i = 0; i < chan->data_len; i++) {
-            fdata[i] = (fdata[i] / chan->scale * pow(10, -chan->dec) + chan->shift) * chan->mul;
-        }
+// Bounds checked view of a range of the mapped file
+static const char* file_range(const LDData* data, long offset, size_t size) {
+    if (offset < 0 || (size_t)offset > data->map.size || size > data->map.size - (size_t)offset) {
+        return NULL;
     }
-    
-    return data;
+    return data->map.data + offset;
+}
+
+static int read_int(const char* p) {
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int read_short(const char* p) {
+    int16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void read_string(char* dest, size_t dest_size, const char* p, size_t len) {
+    char temp[MAX_STRING_LENGTH + 1];
+    memcpy(temp, p, len);
+    temp[len] = '\0';
+    decode_string(dest, temp, dest_size);
+}
+
+static void channel_encoding(const LDChannel* chan, LdEncoding* enc) {
+    enc->dtype = chan->dtype;
+    enc->shift = chan->shift;
+    enc->mul = chan->mul;
+    enc->scale = chan->scale;
+    enc->dec = chan->dec;
+}
+
+// Samples are decoded on first use and kept until the file is freed
+float* ld_channel_data(LDData* data, LDChannel* chan) {
+    if (!data || !chan) return NULL;
+    if (chan->data) return (float*)chan->data;
+    if (chan->data_len < 0 || chan->scale == 0) return NULL;
+
+    LdEncoding enc;
+    channel_encoding(chan, &enc);
+    size_t size = (size_t)chan->data_len * ld_encoding_size(&enc);
+    const char* raw = file_range(data, chan->data_ptr, size);
+    if (!raw) return NULL;
+
+    float* values = malloc(sizeof(float) * (chan->data_len ? (size_t)chan->data_len : 1));
+    if (!values) return NULL;
+
+    ld_decode_float(values, raw, (size_t)chan->data_len, &enc);
+    chan->data = values;
+    return values;
 }
 
-// Read a single channel
-static LDChannel* read_channel(FILE* f, int meta_ptr) {
-    LDChannel* chan = malloc(sizeof(LDChannel));
+// Read a single channel's metadata, the samples are left in the file
+static LDChannel* read_channel(const LDData* data, int meta_ptr) {
+    const char* p = file_range(data, meta_ptr, CHANNEL_RECORD_SIZE);
+    if (!p) return NULL;
+
+    LDChannel* chan = calloc(1, sizeof(LDChannel));
     if (!chan) return NULL;
     
-    fseek(f, meta_ptr, SEEK_SET);
-    
     // Read channel header
-    fread(&chan->prev_meta_ptr, sizeof(int), 1, f);
-    fread(&chan->next_meta_ptr, sizeof(int), 1, f);
-    fread(&chan->data_ptr, sizeof(int), 1, f);
-    fread(&chan->data_len, sizeof(int), 1, f);
+    chan->meta_ptr = meta_ptr;
+    chan->prev_meta_ptr = read_int(p);
+    chan->next_meta_ptr = read_int(p + 4);
+    chan->data_ptr = read_int(p + 8);
+    chan->data_len = read_int(p + 12);
     
     // Read other channel metadata
     uint16_t dtype_a, dtype;
-    fread(&dtype_a, sizeof(uint16_t), 1, f);
-    fread(&dtype, sizeof(uint16_t), 1, f);
+    memcpy(&dtype_a, p + 16, sizeof(uint16_t));
+    memcpy(&dtype, p + 18, sizeof(uint16_t));
     
     // Determine data type
     if (dtype_a == 0x07) {
@@ -77,64 +103,139 @@ static LDChannel* read_channel(FILE* f, int meta_ptr) {
     }
     
     // Read remaining metadata
-    fread(&chan->freq, sizeof(int16_t), 1, f);
-    fread(&chan->shift, sizeof(int16_t), 1, f);
-    fread(&chan->mul, sizeof(int16_t), 1, f);
-    fread(&chan->scale, sizeof(int16_t), 1, f);
-    fread(&chan->dec, sizeof(int16_t), 1, f);
+    chan->freq = read_short(p + 20);
+    chan->shift = read_short(p + 22);
+    chan->mul = read_short(p + 24);
+    chan->scale = read_short(p + 26);
+    chan->dec = read_short(p + 28);
     
     // Read strings
-    char temp[32];
-    fread(temp, 32, 1, f);
-    decode_string(chan->name, temp, sizeof(chan->name));
-    
-    fread(temp, 8, 1, f);
-    decode_string(chan->short_name, temp, sizeof(chan->short_name));
-    
-    fread(temp, 12, 1, f);
-    decode_string(chan->unit, temp, sizeof(chan->unit));
-    
-    // Read actual channel data
-    chan->data = read_channel_data(f, chan);
+    read_string(chan->name, sizeof(chan->name), p + 30, 32);
+    read_string(chan->short_name, sizeof(chan->short_name), p + 62, 8);
+    read_string(chan->unit, sizeof(chan->unit), p + 70, 12);
     
     return chan;
 }
 
+// Header plus the event, venue and vehicle blocks it points to
+static LDHeader* read_header(const LDData* data) {
+    const size_t header_size = 12 + 3 * 64 + sizeof(time_t) + 3 * 64;
+    const char* p = file_range(data, 0, header_size);
+    if (!p) return NULL;
+
+    LDHeader* head = calloc(1, sizeof(LDHeader));
+    if (!head) return NULL;
+
+    head->meta_ptr = read_int(p);
+    head->data_ptr = read_int(p + 4);
+    head->aux_ptr = read_int(p + 8);
+    p += 12;
+    read_string(head->driver, sizeof(head->driver), p, 64);
+    read_string(head->vehicleid, sizeof(head->vehicleid), p + 64, 64);
+    read_string(head->venue, sizeof(head->venue), p + 128, 64);
+    p += 192;
+    memcpy(&head->datetime, p, sizeof(time_t));
+    p += sizeof(time_t);
+    read_string(head->short_comment, sizeof(head->short_comment), p, 64);
+    read_string(head->event, sizeof(head->event), p + 64, 64);
+    read_string(head->session, sizeof(head->session), p + 128, 64);
+
+    // Auxiliary blocks are optional, a bad pointer just leaves them out
+    p = file_range(data, head->aux_ptr, 64 + 64 + 1024 + 4);
+    if (head->aux_ptr && p && (head->aux = calloc(1, sizeof(LDEvent)))) {
+        LDEvent* event = head->aux;
+        read_string(event->name, sizeof(event->name), p, 64);
+        read_string(event->session, sizeof(event->session), p + 64, 64);
+        read_string(event->comment, sizeof(event->comment), p + 128, 1024);
+        event->venue_ptr = read_int(p + 1152);
+
+        p = file_range(data, event->venue_ptr, 64 + 4);
+        if (event->venue_ptr && p && (event->venue = calloc(1, sizeof(LDVenue)))) {
+            LDVenue* venue = event->venue;
+            read_string(venue->name, sizeof(venue->name), p, 64);
+            venue->vehicle_ptr = read_int(p + 64);
+
+            p = file_range(data, venue->vehicle_ptr, 64 + 4 + 32 + 32);
+            if (venue->vehicle_ptr && p && (venue->vehicle = calloc(1, sizeof(LDVehicle)))) {
+                LDVehicle* vehicle = venue->vehicle;
+                read_string(vehicle->id, sizeof(vehicle->id), p, 64);
+                memcpy(&vehicle->weight, p + 64, sizeof(unsigned int));
+                read_string(vehicle->type, sizeof(vehicle->type), p + 68, 32);
+                read_string(vehicle->comment, sizeof(vehicle->comment), p + 100, 32);
+            }
+        }
+    }
+
+    return head;
+}
+
+static int append_channel(LDData* data, LDChannel* chan) {
+    if (data->channel_count >= data->channel_capacity) {
+        int new_capacity = data->channel_capacity ? data->channel_capacity * 2 : INITIAL_CHANNEL_CAPACITY;
+        LDChannel** new_channels = realloc(data->channels, sizeof(LDChannel*) * new_capacity);
+        if (!new_channels) return -1;
+        data->channels = new_channels;
+        data->channel_capacity = new_capacity;
+    }
+    data->channels[data->channel_count++] = chan;
+    return 0;
+}
+
 LDData* ld_read_file(const char* filename) {
-    FILE* f = fopen(filename, "rb");
-    if (!f) return NULL;
-    
-    LDData* data = malloc(sizeof(LDData));
-    if (!data) {
-        fclose(f);
+    LDData* data = calloc(1, sizeof(LDData));
+    if (!data) return NULL;
+
+    if (mapped_file_open(&data->map, filename) != 0) {
+        free(data);
         return NULL;
     }
+
+    // Channels are only picked out as they are used, not read front to back
+    if (data->map.is_mapped) {
+        madvise(data->map.base, data->map.base_size, MADV_RANDOM);
+    }
     
     // Read header
-    data->head = malloc(sizeof(LDHeader));
+    data->head = read_header(data);
     if (!data->head) {
-        free(data);
-        fclose(f);
+        ld_free_data(data);
         return NULL;
     }
     
-    // Read channels
-    data->channels = malloc(sizeof(LDChannel*) * MAX_CHANNELS);
-    data->channel_count = 0;
-    
+    // Walk the channel list. A file can't hold more records than fit in
+    // it, which also stops a corrupt list that loops back on itself.
+    size_t max_channels = data->map.size / CHANNEL_RECORD_SIZE;
     int meta_ptr = data->head->meta_ptr;
-    while (meta_ptr && data->channel_count < MAX_CHANNELS) {
-        LDChannel* chan = read_channel(f, meta_ptr);
+    while (meta_ptr && (size_t)data->channel_count < max_channels) {
+        LDChannel* chan = read_channel(data, meta_ptr);
         if (!chan) break;
         
-        data->channels[data->channel_count++] = chan;
+        if (append_channel(data, chan) != 0) {
+            free(chan);
+            ld_free_data(data);
+            return NULL;
+        }
         meta_ptr = chan->next_meta_ptr;
     }
+
+    // Index the names once so lookups don't scan the channel list
+    for (int i = 0; i < data->channel_count; i++) {
+        if (name_index_insert(&data->names, data->channels[i]->name, i) != 0) {
+            ld_free_data(data);
+            return NULL;
+        }
+    }
     
-    fclose(f);
     return data;
 }
 
+LDChannel* ld_get_channel_by_name(LDData* data, const char* name) {
+    if (!data || !name) return NULL;
+
+    int index = name_index_find(&data->names, name);
+    return index >= 0 ? data->channels[index] : NULL;
+}
+
 // Free all allocated memory
 void ld_free_data(LDData* data) {
     if (!data) return;
@@ -162,5 +263,7 @@ void ld_free_data(LDData* data) {
     }
     
     free(data->channels);
+    name_index_free(&data->names);
+    mapped_file_close(&data->map);
     free(data);
-}
\ No newline at end of file
+}
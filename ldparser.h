@@ -5,9 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "mapped_file.h"
+#include "name_index.h"
 
 #define MAX_STRING_LENGTH 1024
-#define MAX_CHANNELS 500
 
 // Data types for channel data
 typedef enum {
@@ -33,7 +34,7 @@ typedef struct {
     char name[32];
     char short_name[8];
     char unit[12];
-    void* data;  // Pointer to actual channel data
+    void* data;  // Pointer to actual channel data, decoded floats when read
 } LDChannel;
 
 // Vehicle information
@@ -75,15 +76,20 @@ typedef struct {
     char session[64];
 } LDHeader;
 
-// Main data structure
+// Main data structure. The file stays mapped while it is open, channel
+// samples are only decoded when first asked for.
 typedef struct {
     LDHeader* head;
     LDChannel** channels;
     int channel_count;
+    int channel_capacity;
+    NameIndex names;    // Channel name to index in channels
+    MappedFile map;
 } LDData;
 
 // Function declarations
 LDData* ld_read_file(const char* filename);
+float* ld_channel_data(LDData* data, LDChannel* chan);
 void ld_free_data(LDData* data);
 LDChannel* ld_get_channel_by_name(LDData* data, const char* name);
 void ld_write_file(LDData* data, const char* filename);
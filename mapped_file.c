@@ -0,0 +1,113 @@
+#include "mapped_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_CHUNK_SIZE (1 << 20)
+
+// Fallback for streams that can't be mapped, slurp everything that is left
+static int read_stream(MappedFile* map, FILE* f) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char* buffer = malloc(capacity);
+    if (!buffer) return -1;
+
+    size_t n;
+    while ((n = fread(buffer + size, 1, capacity - size, f)) > 0) {
+        size += n;
+        if (size == capacity) {
+            char* new_buffer = realloc(buffer, capacity * 2);
+            if (!new_buffer) {
+                free(buffer);
+                return -1;
+            }
+            buffer = new_buffer;
+            capacity *= 2;
+        }
+    }
+
+    map->base = buffer;
+    map->base_size = capacity;
+    map->data = buffer;
+    map->size = size;
+    map->is_mapped = 0;
+    return 0;
+}
+
+static int map_descriptor(MappedFile* map, int fd, off_t offset) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+
+    if (st.st_size == 0 || offset >= st.st_size) {
+        map->base = NULL;
+        map->base_size = 0;
+        map->data = "";
+        map->size = 0;
+        map->is_mapped = 0;
+        return 0;
+    }
+
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return -1;
+
+    // Inputs are always parsed front to back
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    map->base = base;
+    map->base_size = (size_t)st.st_size;
+    map->data = (const char*)base + offset;
+    map->size = (size_t)(st.st_size - offset);
+    map->is_mapped = 1;
+    return 0;
+}
+
+int mapped_file_open(MappedFile* map, const char* filename) {
+    if (!map || !filename) return -1;
+    memset(map, 0, sizeof(MappedFile));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    int result = map_descriptor(map, fd, 0);
+    close(fd);
+    return result;
+}
+
+int mapped_file_from_stream(MappedFile* map, FILE* f) {
+    if (!map || !f) return -1;
+    memset(map, 0, sizeof(MappedFile));
+
+    // Map from wherever the caller has already read up to
+    long offset = ftell(f);
+    if (offset >= 0 && map_descriptor(map, fileno(f), (off_t)offset) == 0) {
+        return 0;
+    }
+    return read_stream(map, f);
+}
+
+// Drops the pages before upto from memory, a streaming reader calls this as
+// it goes so a mapped file bigger than RAM doesn't stay resident
+void mapped_file_release(MappedFile* map, const char* upto) {
+    if (!map || !map->is_mapped) return;
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = (size_t)(upto - (const char*)map->base);
+    length -= length % page_size;
+    if (length > 0) {
+        madvise(map->base, length, MADV_DONTNEED);
+    }
+}
+
+void mapped_file_close(MappedFile* map) {
+    if (!map) return;
+
+    if (map->is_mapped) {
+        munmap(map->base, map->base_size);
+    } else {
+        free(map->base);
+    }
+    memset(map, 0, sizeof(MappedFile));
+}
@@ -0,0 +1,23 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Read-only view over the contents of a whole file. Regular files are
+// mmap'd; anything that can't be mapped (pipes, stdin) is read into a heap
+// buffer instead so callers only ever deal with a pointer and a length.
+typedef struct {
+    const char* data;
+    size_t size;
+    void* base;        // Start of the mapping or heap buffer
+    size_t base_size;
+    int is_mapped;
+} MappedFile;
+
+int mapped_file_open(MappedFile* map, const char* filename);
+int mapped_file_from_stream(MappedFile* map, FILE* f);
+void mapped_file_release(MappedFile* map, const char* upto);
+void mapped_file_close(MappedFile* map);
+
+#endif
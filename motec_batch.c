@@ -0,0 +1,393 @@
+#include "motec_batch.h"
+#include "thread_pool.h"
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <glob.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define INITIAL_INPUT_CAPACITY 64
+
+// One thread's files, taken from the front by its owner and from the back
+// by thieves
+typedef struct {
+    size_t* items;         // Indices into the input list
+    size_t head;
+    size_t tail;
+    pthread_mutex_t lock;
+} WorkQueue;
+
+typedef struct {
+    const GeneratorArgs* args;
+    char** paths;
+    char** outputs;        // .ld file of every input, NULL if it has none
+    int* results;
+    WorkQueue* queues;
+    int queue_count;
+} BatchJob;
+
+typedef struct {
+    char** paths;
+    size_t count;
+    size_t capacity;
+} InputList;
+
+static int input_list_add(InputList* list, const char* path) {
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity ? list->capacity * 2 : INITIAL_INPUT_CAPACITY;
+        char** new_paths = realloc(list->paths, sizeof(char*) * new_capacity);
+        if (!new_paths) return -1;
+        list->paths = new_paths;
+        list->capacity = new_capacity;
+    }
+
+    char* copy = strdup(path);
+    if (!copy) return -1;
+    list->paths[list->count++] = copy;
+    return 0;
+}
+
+static int is_regular_file(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int is_directory(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int collect_directory(InputList* list, const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return -1;
+
+    int result = 0;
+    struct dirent* entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        size_t len = strlen(dir_path) + strlen(entry->d_name) + 2;
+        char* path = malloc(len);
+        if (!path) {
+            result = -1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir_path, entry->d_name);
+        if (is_regular_file(path)) result = input_list_add(list, path);
+        free(path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+static int collect_glob(InputList* list, const char* pattern) {
+    glob_t matches;
+    int status = glob(pattern, 0, NULL, &matches);
+    if (status == GLOB_NOMATCH) return 0;
+    if (status != 0) return -1;
+
+    int result = 0;
+    for (size_t i = 0; result == 0 && i < matches.gl_pathc; i++) {
+        if (is_regular_file(matches.gl_pathv[i])) {
+            result = input_list_add(list, matches.gl_pathv[i]);
+        }
+    }
+
+    globfree(&matches);
+    return result;
+}
+
+// One path per line, blank lines and # comments are skipped
+static int collect_list_file(InputList* list, const char* list_path) {
+    FILE* f = fopen(list_path, "r");
+    if (!f) return -1;
+
+    int result = 0;
+    char line[4096];
+    while (result == 0 && fgets(line, sizeof(line), f)) {
+        char* path = line;
+        while (isspace((unsigned char)*path)) path++;
+        size_t len = strlen(path);
+        while (len > 0 && isspace((unsigned char)path[len - 1])) path[--len] = '\0';
+        if (*path == '\0' || *path == '#') continue;
+        result = input_list_add(list, path);
+    }
+
+    fclose(f);
+    return result;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int batch_collect_inputs(const char* spec, char*** paths, size_t* count) {
+    if (!spec || !paths || !count) return -1;
+
+    InputList list = { NULL, 0, 0 };
+    struct stat st;
+    int result;
+    if (stat(spec, &st) == 0 && S_ISDIR(st.st_mode)) {
+        result = collect_directory(&list, spec);
+    } else if (strpbrk(spec, "*?[")) {
+        result = collect_glob(&list, spec);
+    } else {
+        result = collect_list_file(&list, spec);
+    }
+
+    if (result != 0) {
+        batch_free_inputs(list.paths, list.count);
+        return -1;
+    }
+
+    if (list.count > 1) qsort(list.paths, list.count, sizeof(char*), compare_paths);
+    *paths = list.paths;
+    *count = list.count;
+    return 0;
+}
+
+void batch_free_inputs(char** paths, size_t count) {
+    if (!paths) return;
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+static int queue_pop(WorkQueue* queue, size_t* item) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *item = queue->items[queue->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int queue_steal(WorkQueue* queue, size_t* item) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *item = queue->items[--queue->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// <output dir>/<input name>.ld
+static char* batch_output_filename(const char* input_path, const char* output_dir) {
+    if (!output_dir) return get_output_filename(input_path, NULL);
+
+    char* input = strdup(input_path);
+    if (!input) return NULL;
+    char* name = basename(input);
+
+    size_t len = strlen(output_dir) + strlen(name) + 5;
+    char* joined = malloc(len);
+    if (joined) snprintf(joined, len, "%s/%s", output_dir, name);
+    free(input);
+    if (!joined) return NULL;
+
+    char* output = get_output_filename(joined, NULL);
+    free(joined);
+    return output;
+}
+
+static void convert_one(BatchJob* job, size_t index, IoEngine* io, IoRead* input) {
+    // Every file gets its own copy of the options and its own logs, nothing
+    // carries over from one conversion to the next
+    GeneratorArgs file_args = *job->args;
+    file_args.log_path = job->paths[index];
+    file_args.output_path = job->outputs[index];
+    file_args.io = io;
+    file_args.input = input;
+    file_args.stats = NULL;     // Only the batch as a whole is timed
+    file_args.quiet = 1;        // Progress of concurrent files would interleave
+
+    job->results[index] = process_log_file(&file_args);
+}
+
+static int take_work(BatchJob* job, size_t index, size_t* item) {
+    if (queue_pop(&job->queues[index], item)) return 1;
+
+    // Own queue is empty, steal the smallest file of the next busy one
+    for (int i = 1; i < job->queue_count; i++) {
+        if (queue_steal(&job->queues[(index + i) % job->queue_count], item)) return 1;
+    }
+    return 0;
+}
+
+static void batch_worker(void* ctx, size_t index) {
+    BatchJob* job = (BatchJob*)ctx;
+    const GeneratorArgs* args = job->args;
+    int streaming = args->stream && args->log_type == LOG_TYPE_CSV;
+    IoEngine* io = args->io_uring && !streaming ? io_engine_create() : NULL;
+
+    // With an engine the next file is claimed early and its read started,
+    // so it loads while this one is parsed, encoded and written
+    size_t item;
+    if (!take_work(job, index, &item)) {
+        io_engine_destroy(io);
+        return;
+    }
+    IoRead* input = io ? io_engine_start_read(io, job->paths[item]) : NULL;
+
+    for (;;) {
+        size_t next;
+        int has_next = take_work(job, index, &next);
+        IoRead* next_input = has_next && io ? io_engine_start_read(io, job->paths[next]) : NULL;
+
+        convert_one(job, item, io, input);
+        if (!has_next) break;
+
+        item = next;
+        input = next_input;
+    }
+
+    io_engine_destroy(io);
+}
+
+typedef struct {
+    size_t index;
+    off_t size;
+} SizedInput;
+
+static int compare_sizes_descending(const void* a, const void* b) {
+    off_t size_a = ((const SizedInput*)a)->size;
+    off_t size_b = ((const SizedInput*)b)->size;
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+typedef struct {
+    size_t index;
+    const char* output;
+} NamedOutput;
+
+static int compare_outputs(const void* a, const void* b) {
+    return strcmp(((const NamedOutput*)a)->output, ((const NamedOutput*)b)->output);
+}
+
+// Works out every input's output file and fails the inputs that share one,
+// converting them concurrently would have them overwrite each other.
+// Returns how many inputs were failed, or -1.
+static int plan_outputs(BatchJob* job, size_t count) {
+    NamedOutput* named = malloc(sizeof(NamedOutput) * count);
+    if (!named) return -1;
+
+    size_t named_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        job->outputs[i] = batch_output_filename(job->paths[i], job->args->output_path);
+        if (!job->outputs[i]) {
+            job->results[i] = -1;
+            continue;
+        }
+        named[named_count].index = i;
+        named[named_count].output = job->outputs[i];
+        named_count++;
+    }
+    qsort(named, named_count, sizeof(NamedOutput), compare_outputs);
+
+    int failed = 0;
+    for (size_t i = 0; i < named_count;) {
+        size_t end = i + 1;
+        while (end < named_count && strcmp(named[end].output, named[i].output) == 0) end++;
+        if (end - i > 1) {
+            for (size_t j = i; j < end; j++) {
+                printf("ERROR: %s would overwrite another log's output %s\n",
+                       job->paths[named[j].index], named[j].output);
+                job->results[named[j].index] = -1;
+                failed++;
+            }
+        }
+        i = end;
+    }
+    free(named);
+    return failed;
+}
+
+int batch_convert(const GeneratorArgs* args, char** paths, size_t count) {
+    if (!args || (!paths && count > 0)) return -1;
+    if (count == 0) return 0;
+
+    if (args->output_path && mkdir(args->output_path, 0700) != 0 &&
+        (errno != EEXIST || !is_directory(args->output_path))) {
+        printf("ERROR: Cannot create output directory: %s\n", args->output_path);
+        return -1;
+    }
+
+    ThreadPool* pool = thread_pool_default();
+    int queue_count = thread_pool_size(pool);
+    if ((size_t)queue_count > count) queue_count = (int)count;
+
+    BatchJob job;
+    job.args = args;
+    job.paths = paths;
+    job.queue_count = queue_count;
+    job.outputs = calloc(count, sizeof(char*));
+    job.results = calloc(count, sizeof(int));
+    job.queues = calloc((size_t)queue_count, sizeof(WorkQueue));
+    SizedInput* inputs = malloc(sizeof(SizedInput) * count);
+    if (!job.outputs || !job.results || !job.queues || !inputs ||
+        plan_outputs(&job, count) < 0) {
+        if (job.outputs) {
+            for (size_t i = 0; i < count; i++) free(job.outputs[i]);
+        }
+        free(job.outputs);
+        free(job.results);
+        free(job.queues);
+        free(inputs);
+        return -1;
+    }
+
+    // Deal the files out largest first so every queue starts with a share
+    // of the big ones
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        inputs[i].index = i;
+        inputs[i].size = stat(paths[i], &st) == 0 ? st.st_size : 0;
+    }
+    qsort(inputs, count, sizeof(SizedInput), compare_sizes_descending);
+
+    int result = 0;
+    for (int q = 0; q < queue_count; q++) {
+        WorkQueue* queue = &job.queues[q];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->items = malloc(sizeof(size_t) * (count / (size_t)queue_count + 1));
+        if (!queue->items) result = -1;
+    }
+    // Inputs already failed by plan_outputs are left out
+    size_t dealt = 0;
+    for (size_t i = 0; result == 0 && i < count; i++) {
+        if (job.results[inputs[i].index] != 0) continue;
+        WorkQueue* queue = &job.queues[dealt++ % (size_t)queue_count];
+        queue->items[queue->tail++] = inputs[i].index;
+    }
+
+    if (result == 0) {
+        thread_pool_parallel_for(pool, (size_t)queue_count, batch_worker, &job);
+
+        for (size_t i = 0; i < count; i++) {
+            if (job.results[i] != 0) {
+                printf("FAILED: %s\n", paths[i]);
+                result++;
+            }
+        }
+        if (!args->quiet) printf("Converted %zu of %zu logs\n", count - (size_t)result, count);
+    }
+
+    for (int q = 0; q < queue_count; q++) {
+        free(job.queues[q].items);
+        pthread_mutex_destroy(&job.queues[q].lock);
+    }
+    for (size_t i = 0; i < count; i++) free(job.outputs[i]);
+    free(job.outputs);
+    free(job.queues);
+    free(job.results);
+    free(inputs);
+    return result;
+}
@@ -0,0 +1,21 @@
+#ifndef MOTEC_BATCH_H
+#define MOTEC_BATCH_H
+
+#include "motec_log_generator.h"
+
+// Expands a batch input into the logs it names: every regular file in a
+// directory, the matches of a glob pattern, or the lines of a list file.
+// Paths are returned sorted and must be freed with batch_free_inputs.
+int batch_collect_inputs(const char* spec, char*** paths, size_t* count);
+void batch_free_inputs(char** paths, size_t count);
+
+// Converts every log with the same options, several at once. Each thread
+// of the default pool owns a queue of files dealt out largest first and
+// steals from the others when its own runs dry. A large file's parse and
+// write loops are picked up by threads with nothing left to convert.
+// With args->output_path set, outputs go in that directory. Inputs that
+// would convert to the same .ld file are failed rather than converted.
+// Returns the number of logs that failed to convert, or -1.
+int batch_convert(const GeneratorArgs* args, char** paths, size_t count);
+
+#endif
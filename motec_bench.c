@@ -0,0 +1,607 @@
+// Throughput benchmark for the conversion stages on synthetic logs.
+//
+// Build from the repo root, the generator's own main and the batch driver
+// that calls into it are left out:
+//
+//   gcc -std=gnu11 -O2 -pthread -o motec_bench $(ls *.c | grep -v -e motec_log_generator.c -e motec_batch.c) -lm
+//
+// (motec_log_generator itself is every .c file but this one.)
+//
+// Inputs are generated in memory from a fixed seed, so a shape always gives
+// the same bytes: a CSV log of rows x columns sampled at rate Hz, a candump
+// log with the same signals packed four to a message plus the DBC for it,
+// and the .ld file the write stage produces. --emit keeps them on disk to
+// run motec_log_generator on.
+//
+// Every stage is timed on its own, best of --iterations runs:
+//   csv_ingest  datalog_from_csv_buffer
+//   can_ingest  datalog_from_can_buffer
+//   resample    datalog_resample of the CSV log to --resample Hz
+//   encode      float32 encoding of every channel into memory
+//   write       motec_log_write of the CSV log
+//   read        ld_read_file and decoding every channel
+//
+// --save stores the results as the baseline for the shape, later runs
+// compare against it and exit with 1 when a stage's samples/s dropped by
+// more than --tolerance percent.
+#include "data_log.h"
+#include "dbc.h"
+#include "ld_codec.h"
+#include "ldparser.h"
+#include "motec_log.h"
+#include "thread_pool.h"
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ROWS 100000
+#define DEFAULT_COLUMNS 40
+#define DEFAULT_RATE 100.0
+#define DEFAULT_RESAMPLE 20.0
+#define DEFAULT_ITERATIONS 3
+#define DEFAULT_TOLERANCE 10.0
+#define DEFAULT_BASELINE "motec_bench_baseline.txt"
+#define SIGNALS_PER_MESSAGE 4
+#define FIRST_MESSAGE_ID 0x100
+#define MAX_COLUMNS ((0x7ff - FIRST_MESSAGE_ID + 1) * SIGNALS_PER_MESSAGE)
+#define MAX_BASELINES 256
+
+typedef struct {
+    size_t rows;
+    size_t columns;
+    double rate;
+    double resample;
+    int iterations;
+    int threads;
+    const char* baseline_path;
+    int save;
+    double tolerance;
+    const char* emit_dir;
+} BenchArgs;
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    const char* stage;
+    double seconds;     // Best run
+    double bytes;
+    double samples;
+} StageResult;
+
+typedef struct {
+    char key[96];       // "<stage> <shape>"
+    double mb_per_s;
+    double samples_per_s;
+} Baseline;
+
+// Same sequence on every run and every machine
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double rng_uniform(void) {
+    return (double)(rng_next() >> 11) / 9007199254740992.0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int buffer_printf(Buffer* buffer, const char* format, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, format);
+        int n = vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, ap);
+        va_end(ap);
+        if (n < 0) return -1;
+        if ((size_t)n < buffer->capacity - buffer->size) {
+            buffer->size += (size_t)n;
+            return 0;
+        }
+
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : (1 << 20);
+        while (capacity - buffer->size <= (size_t)n) capacity *= 2;
+        char* data = realloc(buffer->data, capacity);
+        if (!data) return -1;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+}
+
+// A smooth signal with a little noise, each column at its own frequency
+static double signal_value(size_t column, double t) {
+    double freq = 0.05 + 0.37 * (double)(column % 11);
+    double amplitude = 10.0 * (double)(1 + column % 5);
+    return amplitude * sin(2.0 * M_PI * freq * t + (double)column) + (rng_uniform() - 0.5);
+}
+
+// Time, then columns with 0 to 3 decimals. Every seventh column drops the
+// odd cell so the missing sample path is part of the work.
+static int generate_csv(const BenchArgs* args, Buffer* csv) {
+    if (buffer_printf(csv, "Time") != 0) return -1;
+    for (size_t c = 0; c < args->columns; c++) {
+        if (buffer_printf(csv, ",Channel %zu", c) != 0) return -1;
+    }
+    if (buffer_printf(csv, "\ns") != 0) return -1;
+    for (size_t c = 0; c < args->columns; c++) {
+        if (buffer_printf(csv, ",unit%zu", c % 4) != 0) return -1;
+    }
+    if (buffer_printf(csv, "\n") != 0) return -1;
+
+    for (size_t r = 0; r < args->rows; r++) {
+        double t = (double)r / args->rate;
+        if (buffer_printf(csv, "%.3f", t) != 0) return -1;
+        for (size_t c = 0; c < args->columns; c++) {
+            if (c % 7 == 3 && r % 97 == 5) {
+                if (buffer_printf(csv, ",") != 0) return -1;
+            } else if (buffer_printf(csv, ",%.*f", (int)(c % 4), signal_value(c, t)) != 0) {
+                return -1;
+            }
+        }
+        if (buffer_printf(csv, "\n") != 0) return -1;
+    }
+    return 0;
+}
+
+static size_t message_count(const BenchArgs* args) {
+    return (args->columns + SIGNALS_PER_MESSAGE - 1) / SIGNALS_PER_MESSAGE;
+}
+
+// Four signed 16 bit little endian signals per 8 byte message
+static int generate_dbc(const BenchArgs* args, Buffer* dbc) {
+    if (buffer_printf(dbc, "VERSION \"\"\n\nBU_: BENCH\n\n") != 0) return -1;
+    for (size_t m = 0; m < message_count(args); m++) {
+        if (buffer_printf(dbc, "BO_ %zu MSG_%zu: 8 BENCH\n", FIRST_MESSAGE_ID + m, m) != 0) return -1;
+        for (size_t s = 0; s < SIGNALS_PER_MESSAGE; s++) {
+            size_t c = m * SIGNALS_PER_MESSAGE + s;
+            if (c >= args->columns) break;
+            if (buffer_printf(dbc, " SG_ Signal_%zu : %zu|16@1- (0.01,0) [-327.68|327.67] \"unit%zu\" BENCH\n",
+                              c, s * 16, c % 4) != 0) return -1;
+        }
+        if (buffer_printf(dbc, "\n") != 0) return -1;
+    }
+    return 0;
+}
+
+// rows frames of every message, interleaved in time order
+static int generate_candump(const BenchArgs* args, Buffer* log) {
+    const double start = 1600000000.0;
+    size_t messages = message_count(args);
+
+    for (size_t r = 0; r < args->rows; r++) {
+        for (size_t m = 0; m < messages; m++) {
+            double t = ((double)r + (double)m / (double)messages) / args->rate;
+            uint64_t micros = (uint64_t)llround((start + t) * 1e6);
+            if (buffer_printf(log, "(%llu.%06llu) can0 %03zX#",
+                              (unsigned long long)(micros / 1000000),
+                              (unsigned long long)(micros % 1000000), FIRST_MESSAGE_ID + m) != 0) return -1;
+
+            for (size_t s = 0; s < SIGNALS_PER_MESSAGE; s++) {
+                size_t c = m * SIGNALS_PER_MESSAGE + s;
+                int16_t raw = c < args->columns ? (int16_t)lround(signal_value(c, t) * 100.0) : 0;
+                uint16_t bits = (uint16_t)raw;
+                if (buffer_printf(log, "%02X%02X", bits & 0xff, bits >> 8) != 0) return -1;
+            }
+            if (buffer_printf(log, "\n") != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static size_t datalog_samples(DataLog* log) {
+    size_t samples = 0;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        samples += log->channels[i]->message_count;
+    }
+    return samples;
+}
+
+static void record(StageResult* result, double seconds, double bytes, double samples) {
+    if (result->seconds == 0.0 || seconds < result->seconds) result->seconds = seconds;
+    result->bytes = bytes;
+    result->samples = samples;
+}
+
+static int bench_csv_ingest(const BenchArgs* args, const Buffer* csv, StageResult* result) {
+    for (int i = 0; i < args->iterations; i++) {
+        DataLog* log = datalog_create("");
+        if (!log) return -1;
+
+        double start = now_seconds();
+        int status = datalog_from_csv_buffer(log, csv->data, csv->size);
+        double seconds = now_seconds() - start;
+
+        size_t samples = datalog_samples(log);
+        datalog_free(log);
+        if (status != 0) return -1;
+        record(result, seconds, (double)csv->size, (double)samples);
+    }
+    return 0;
+}
+
+static int bench_can_ingest(const BenchArgs* args, const Buffer* candump, const Buffer* dbc_text,
+                            StageResult* result) {
+    Dbc* dbc = dbc_parse(dbc_text->data, dbc_text->size);
+    if (!dbc) return -1;
+
+    int status = 0;
+    for (int i = 0; i < args->iterations && status == 0; i++) {
+        DataLog* log = datalog_create("");
+        if (!log) {
+            status = -1;
+            break;
+        }
+
+        double start = now_seconds();
+        status = datalog_from_can_buffer(log, candump->data, candump->size, dbc);
+        double seconds = now_seconds() - start;
+
+        record(result, seconds, (double)candump->size, (double)datalog_samples(log));
+        datalog_free(log);
+    }
+    dbc_free(dbc);
+    return status;
+}
+
+static int bench_resample(const BenchArgs* args, const Buffer* csv, StageResult* result) {
+    for (int i = 0; i < args->iterations; i++) {
+        DataLog* log = datalog_create("");
+        if (!log || datalog_from_csv_buffer(log, csv->data, csv->size) != 0) {
+            datalog_free(log);
+            return -1;
+        }
+
+        double start = now_seconds();
+        int status = datalog_resample(log, args->resample);
+        double seconds = now_seconds() - start;
+
+        size_t samples = datalog_samples(log);
+        datalog_free(log);
+        if (status != 0) return -1;
+        record(result, seconds, (double)samples * sizeof(double), (double)samples);
+    }
+    return 0;
+}
+
+typedef struct {
+    DataLog* log;
+    float** outputs;
+} EncodeJob;
+
+static void encode_channel(void* ctx, size_t index) {
+    EncodeJob* job = (EncodeJob*)ctx;
+    const Channel* channel = job->log->channels[index];
+    LdEncoding enc = {DTYPE_FLOAT32, 0, 1, 1, 0};
+    ld_encode(job->outputs[index], channel->values, channel->message_count, &enc);
+}
+
+static int bench_encode(const BenchArgs* args, DataLog* log, StageResult* result) {
+    EncodeJob job;
+    job.log = log;
+    job.outputs = calloc(log->channel_count ? log->channel_count : 1, sizeof(float*));
+    if (!job.outputs) return -1;
+
+    int status = 0;
+    size_t samples = datalog_samples(log);
+    for (size_t i = 0; i < log->channel_count && status == 0; i++) {
+        job.outputs[i] = malloc(sizeof(float) * (log->channels[i]->message_count + 1));
+        if (!job.outputs[i]) status = -1;
+    }
+
+    for (int i = 0; i < args->iterations && status == 0; i++) {
+        double start = now_seconds();
+        thread_pool_parallel_for(thread_pool_default(), log->channel_count, encode_channel, &job);
+        record(result, now_seconds() - start, (double)samples * sizeof(float), (double)samples);
+    }
+
+    for (size_t i = 0; i < log->channel_count; i++) free(job.outputs[i]);
+    free(job.outputs);
+    return status;
+}
+
+static int bench_write(const BenchArgs* args, DataLog* log, const char* ld_path, StageResult* result) {
+    size_t samples = datalog_samples(log);
+    for (int i = 0; i < args->iterations; i++) {
+        MotecLog* motec_log = motec_log_create();
+        if (!motec_log) return -1;
+        motec_log_set_metadata(motec_log, "Bench", "", 0, "", "", "", "", "", "", "");
+        motec_log_initialize(motec_log);
+
+        double start = now_seconds();
+        int status = motec_log_add_all_channels(motec_log, log);
+        if (status == 0) status = motec_log_write(motec_log, ld_path);
+        double seconds = now_seconds() - start;
+        motec_log_free(motec_log);
+        if (status != 0) return -1;
+
+        struct stat st;
+        if (stat(ld_path, &st) != 0) return -1;
+        record(result, seconds, (double)st.st_size, (double)samples);
+    }
+    return 0;
+}
+
+static int bench_read(const BenchArgs* args, const char* ld_path, StageResult* result) {
+    for (int i = 0; i < args->iterations; i++) {
+        double start = now_seconds();
+        LDData* data = ld_read_file(ld_path);
+        if (!data) return -1;
+
+        size_t samples = 0;
+        for (int c = 0; c < data->channel_count; c++) {
+            if (!ld_channel_data(data, data->channels[c])) {
+                ld_free_data(data);
+                return -1;
+            }
+            samples += (size_t)data->channels[c]->data_len;
+        }
+        double seconds = now_seconds() - start;
+        double bytes = (double)data->map.size;
+        ld_free_data(data);
+        record(result, seconds, bytes, (double)samples);
+    }
+    return 0;
+}
+
+static int write_file(const char* dir, const char* name, const Buffer* buffer) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    int result = fwrite(buffer->data, 1, buffer->size, f) == buffer->size ? 0 : -1;
+    if (fclose(f) != 0) result = -1;
+    return result;
+}
+
+static int load_baselines(const char* path, Baseline* baselines, size_t* count) {
+    *count = 0;
+    FILE* f = fopen(path, "r");
+    if (!f) return errno == ENOENT ? 0 : -1;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f) && *count < MAX_BASELINES) {
+        char stage[48], shape[48];
+        Baseline* baseline = &baselines[*count];
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%47s %47s %lf %lf", stage, shape, &baseline->mb_per_s,
+                   &baseline->samples_per_s) != 4) continue;
+        snprintf(baseline->key, sizeof(baseline->key), "%s %s", stage, shape);
+        (*count)++;
+    }
+    fclose(f);
+    return 0;
+}
+
+static Baseline* find_baseline(Baseline* baselines, size_t count, const char* key) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(baselines[i].key, key) == 0) return &baselines[i];
+    }
+    return NULL;
+}
+
+static int save_baselines(const char* path, const Baseline* baselines, size_t count) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "# motec_bench baselines: stage shape MB/s samples/s\n");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "%s %.3f %.0f\n", baselines[i].key, baselines[i].mb_per_s, baselines[i].samples_per_s);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// Prints every stage against its baseline, merges the results in with
+// --save. Returns the number of regressions.
+static int report(const BenchArgs* args, const StageResult* results, size_t count) {
+    Baseline baselines[MAX_BASELINES];
+    size_t baseline_count;
+    if (load_baselines(args->baseline_path, baselines, &baseline_count) != 0) {
+        printf("WARNING: Cannot read baselines from %s\n", args->baseline_path);
+        baseline_count = 0;
+    }
+
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%zux%zu@%g", args->rows, args->columns, args->rate);
+    printf("%-11s %-18s %10s %12s %12s %8s\n", "stage", "shape", "MB/s", "Msamples/s", "baseline", "change");
+
+    int regressions = 0;
+    for (size_t i = 0; i < count; i++) {
+        const StageResult* result = &results[i];
+        double seconds = result->seconds > 0.0 ? result->seconds : 1e-9;
+        double mb_per_s = result->bytes / seconds / (1 << 20);
+        double samples_per_s = result->samples / seconds;
+
+        char key[96];
+        snprintf(key, sizeof(key), "%s %s", result->stage, shape);
+        Baseline* baseline = find_baseline(baselines, baseline_count, key);
+
+        printf("%-11s %-18s %10.1f %12.2f", result->stage, shape, mb_per_s, samples_per_s / 1e6);
+        if (baseline && baseline->samples_per_s > 0.0) {
+            double change = (samples_per_s / baseline->samples_per_s - 1.0) * 100.0;
+            int regressed = change < -args->tolerance;
+            printf(" %12.2f %+7.1f%%%s\n", baseline->samples_per_s / 1e6, change,
+                   regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        } else {
+            printf(" %12s %8s\n", "-", "-");
+        }
+
+        if (args->save) {
+            if (!baseline && baseline_count < MAX_BASELINES) {
+                baseline = &baselines[baseline_count++];
+                snprintf(baseline->key, sizeof(baseline->key), "%s", key);
+            }
+            if (baseline) {
+                baseline->mb_per_s = mb_per_s;
+                baseline->samples_per_s = samples_per_s;
+            }
+        }
+    }
+
+    if (args->save) {
+        if (save_baselines(args->baseline_path, baselines, baseline_count) != 0) {
+            printf("ERROR: Cannot write baselines to %s\n", args->baseline_path);
+            return -1;
+        }
+        printf("Saved baselines to %s\n", args->baseline_path);
+    }
+    return regressions;
+}
+
+static void print_usage(void) {
+    printf("Usage: motec_bench [options]\n\n");
+    printf("Options:\n");
+    printf("  --rows <n>             Samples per channel, defaults to %d\n", DEFAULT_ROWS);
+    printf("  --columns <n>          Channels, defaults to %d\n", DEFAULT_COLUMNS);
+    printf("  --rate <hz>            Sample rate of the inputs, defaults to %g\n", DEFAULT_RATE);
+    printf("  --resample <hz>        Rate the resample stage converts to, defaults to %g\n", DEFAULT_RESAMPLE);
+    printf("  --iterations <n>       Runs per stage, the best one counts, defaults to %d\n", DEFAULT_ITERATIONS);
+    printf("  --threads <n>          Worker threads, defaults to one per CPU\n");
+    printf("  --baseline <file>      Baseline file, defaults to %s\n", DEFAULT_BASELINE);
+    printf("  --save                 Store this run as the baseline for its shape\n");
+    printf("  --tolerance <percent>  Slowdown flagged as a regression, defaults to %g\n", DEFAULT_TOLERANCE);
+    printf("  --emit <dir>           Keep the generated inputs in dir\n");
+}
+
+static int parse_bench_arguments(int argc, char** argv, BenchArgs* args) {
+    memset(args, 0, sizeof(BenchArgs));
+    args->rows = DEFAULT_ROWS;
+    args->columns = DEFAULT_COLUMNS;
+    args->rate = DEFAULT_RATE;
+    args->resample = DEFAULT_RESAMPLE;
+    args->iterations = DEFAULT_ITERATIONS;
+    args->baseline_path = DEFAULT_BASELINE;
+    args->tolerance = DEFAULT_TOLERANCE;
+
+    static struct option long_options[] = {
+        {"rows", required_argument, 0, 'r'},
+        {"columns", required_argument, 0, 'c'},
+        {"rate", required_argument, 0, 'f'},
+        {"resample", required_argument, 0, 'R'},
+        {"iterations", required_argument, 0, 'n'},
+        {"threads", required_argument, 0, 'j'},
+        {"baseline", required_argument, 0, 'b'},
+        {"save", no_argument, 0, 's'},
+        {"tolerance", required_argument, 0, 't'},
+        {"emit", required_argument, 0, 'e'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:c:f:R:n:j:b:st:e:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': args->rows = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'c': args->columns = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'f': args->rate = atof(optarg); break;
+            case 'R': args->resample = atof(optarg); break;
+            case 'n': args->iterations = atoi(optarg); break;
+            case 'j': args->threads = atoi(optarg); break;
+            case 'b': args->baseline_path = optarg; break;
+            case 's': args->save = 1; break;
+            case 't': args->tolerance = atof(optarg); break;
+            case 'e': args->emit_dir = optarg; break;
+            default:
+                print_usage();
+                return -1;
+        }
+    }
+
+    if (args->rows < 2 || args->columns == 0 || args->rate <= 0.0 || args->resample <= 0.0 ||
+        args->iterations < 1) {
+        printf("ERROR: Need at least 2 rows, 1 column, 1 iteration and positive rates\n");
+        return -1;
+    }
+
+    // Messages get standard IDs from 0x100 up
+    if (args->columns > MAX_COLUMNS) {
+        printf("ERROR: At most %d columns\n", MAX_COLUMNS);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    BenchArgs args;
+    if (parse_bench_arguments(argc, argv, &args) != 0) return 2;
+
+    thread_pool_set_default_threads(args.threads);
+
+    printf("Generating %zu rows x %zu columns at %g Hz...\n", args.rows, args.columns, args.rate);
+    Buffer csv = {0}, candump = {0}, dbc = {0};
+    if (generate_csv(&args, &csv) != 0 || generate_dbc(&args, &dbc) != 0 ||
+        generate_candump(&args, &candump) != 0) {
+        printf("ERROR: Out of memory generating inputs\n");
+        return 2;
+    }
+    printf("CSV %.1f MiB, candump %.1f MiB\n", (double)csv.size / (1 << 20), (double)candump.size / (1 << 20));
+
+    // The .ld file goes with the other inputs or in a scratch directory
+    char scratch[] = "/tmp/motec_bench.XXXXXX";
+    const char* dir = args.emit_dir;
+    if (dir) {
+        mkdir(dir, 0700);
+    } else if (!(dir = mkdtemp(scratch))) {
+        printf("ERROR: Cannot create a scratch directory\n");
+        return 2;
+    }
+    char ld_path[4096];
+    snprintf(ld_path, sizeof(ld_path), "%s/bench.ld", dir);
+
+    if (args.emit_dir && (write_file(dir, "bench.csv", &csv) != 0 ||
+                          write_file(dir, "bench.log", &candump) != 0 ||
+                          write_file(dir, "bench.dbc", &dbc) != 0)) {
+        printf("ERROR: Cannot write inputs to %s\n", dir);
+        return 2;
+    }
+
+    StageResult results[] = {
+        {"csv_ingest", 0, 0, 0}, {"can_ingest", 0, 0, 0}, {"resample", 0, 0, 0},
+        {"encode", 0, 0, 0}, {"write", 0, 0, 0}, {"read", 0, 0, 0},
+    };
+    size_t result_count = sizeof(results) / sizeof(results[0]);
+
+    int status = bench_csv_ingest(&args, &csv, &results[0]);
+    if (status == 0) status = bench_can_ingest(&args, &candump, &dbc, &results[1]);
+    if (status == 0) status = bench_resample(&args, &csv, &results[2]);
+
+    DataLog* log = status == 0 ? datalog_create("") : NULL;
+    if (status == 0 && (!log || datalog_from_csv_buffer(log, csv.data, csv.size) != 0)) status = -1;
+    if (status == 0) status = bench_encode(&args, log, &results[3]);
+    if (status == 0) status = bench_write(&args, log, ld_path, &results[4]);
+    if (status == 0) status = bench_read(&args, ld_path, &results[5]);
+    datalog_free(log);
+
+    if (!args.emit_dir) {
+        unlink(ld_path);
+        rmdir(dir);
+    }
+    free(csv.data);
+    free(candump.data);
+    free(dbc.data);
+
+    int regressions = 0;
+    if (status != 0) {
+        printf("ERROR: A benchmark stage failed\n");
+    } else {
+        regressions = report(&args, results, result_count);
+        if (regressions > 0) printf("%d stage(s) regressed by more than %g%%\n", regressions, args.tolerance);
+    }
+
+    thread_pool_shutdown_default();
+    if (status != 0 || regressions < 0) return 2;
+    return regressions > 0 ? 1 : 0;
+}
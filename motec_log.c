@@ -1,7 +1,18 @@
 #include "motec_log.h"
+#include "ld_codec.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <limits.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #define INITIAL_CHANNEL_CAPACITY 1000
+#define WRITE_BLOCK_SAMPLES (1 << 18)
 
 MotecLog* motec_log_create(void) {
     MotecLog* log = (MotecLog*)malloc(sizeof(MotecLog));
@@ -12,7 +23,10 @@ MotecLog* motec_log_create(void) {
     // Initialize arrays
     log->channel_capacity = INITIAL_CHANNEL_CAPACITY;
     log->ld_channels = (LDChannel**)malloc(sizeof(LDChannel*) * log->channel_capacity);
-    if (!log->ld_channels) {
+    log->sources = (const Channel**)malloc(sizeof(Channel*) * log->channel_capacity);
+    if (!log->ld_channels || !log->sources) {
+        free(log->ld_channels);
+        free(log->sources);
         free(log);
         return NULL;
     }
@@ -26,18 +40,15 @@ MotecLog* motec_log_create(void) {
 void motec_log_free(MotecLog* log) {
     if (!log) return;
     
-    // Free channels
+    // Free channels, their data lives in the arena
     if (log->ld_channels) {
         for (int i = 0; i < log->channel_count; i++) {
-            if (log->ld_channels[i]) {
-                if (log->ld_channels[i]->data) {
-                    free(log->ld_channels[i]->data);
-                }
-                free(log->ld_channels[i]);
-            }
+            free(log->ld_channels[i]);
         }
         free(log->ld_channels);
     }
+    free(log->data_arena);
+    free(log->sources);
     
     // Free header
     if (log->ld_header) {
@@ -60,7 +71,7 @@ int motec_log_initialize(MotecLog* log) {
     if (!log) return -1;
     
     // Create vehicle
-    LDVehicle* vehicle = (LDVehicle*)malloc(sizeof(LDVehicle));
+    LDVehicle* vehicle = (LDVehicle*)calloc(1, sizeof(LDVehicle));
     if (!vehicle) return -1;
     
     strncpy(vehicle->id, log->vehicle_id, sizeof(vehicle->id)-1);
@@ -69,7 +80,7 @@ int motec_log_initialize(MotecLog* log) {
     strncpy(vehicle->comment, log->vehicle_comment, sizeof(vehicle->comment)-1);
     
     // Create venue
-    LDVenue* venue = (LDVenue*)malloc(sizeof(LDVenue));
+    LDVenue* venue = (LDVenue*)calloc(1, sizeof(LDVenue));
     if (!venue) {
         free(vehicle);
         return -1;
@@ -80,7 +91,7 @@ int motec_log_initialize(MotecLog* log) {
     venue->vehicle = vehicle;
     
     // Create event
-    LDEvent* event = (LDEvent*)malloc(sizeof(LDEvent));
+    LDEvent* event = (LDEvent*)calloc(1, sizeof(LDEvent));
     if (!event) {
         free(venue);
         free(vehicle);
@@ -94,7 +105,7 @@ int motec_log_initialize(MotecLog* log) {
     event->venue = venue;
     
     // Create header
-    log->ld_header = (LDHeader*)malloc(sizeof(LDHeader));
+    log->ld_header = (LDHeader*)calloc(1, sizeof(LDHeader));
     if (!log->ld_header) {
         free(event);
         free(venue);
@@ -117,75 +128,63 @@ int motec_log_initialize(MotecLog* log) {
     return 0;
 }
 
-int motec_log_add_channel(MotecLog* log, Channel* channel) {
-    if (!log || !channel) return -1;
+// Adds a channel with no samples attached yet. Offsets are left to
+// motec_log_plan_layout once every channel is known.
+LDChannel* motec_log_append_channel(MotecLog* log, const char* name, const char* units,
+                                   int freq, int sample_count) {
+    if (!log || !name || !units) return NULL;
 
-    // Debug
-    // printf("Debug - Adding channel '%s' with unit '%s'\n", 
-    //     channel->name, channel->units);
-    
     // Check capacity
     if (log->channel_count >= log->channel_capacity) {
         int new_capacity = log->channel_capacity * 2;
         LDChannel** new_channels = (LDChannel**)realloc(log->ld_channels, 
             sizeof(LDChannel*) * new_capacity);
-        if (!new_channels) return -1;
-        
+        if (!new_channels) return NULL;
         log->ld_channels = new_channels;
+
+        const Channel** new_sources = (const Channel**)realloc(log->sources,
+            sizeof(Channel*) * new_capacity);
+        if (!new_sources) return NULL;
+        log->sources = new_sources;
+        
         log->channel_capacity = new_capacity;
     }
     
-    // Advance header data pointer
-    log->ld_header->data_ptr += sizeof(LDChannel);
-    
-    // Advance data pointers of previous channels
-    for (int i = 0; i < log->channel_count; i++) {
-        log->ld_channels[i]->data_ptr += sizeof(LDChannel);
-    }
-    
-    // Calculate pointers
-    int meta_ptr, prev_meta_ptr, data_ptr;
-    if (log->channel_count > 0) {
-        meta_ptr = log->ld_channels[log->channel_count-1]->next_meta_ptr;
-        prev_meta_ptr = log->ld_channels[log->channel_count-1]->meta_ptr;
-        data_ptr = log->ld_channels[log->channel_count-1]->data_ptr + 
-            log->ld_channels[log->channel_count-1]->data_len * sizeof(float);
-    } else {
-        meta_ptr = HEADER_PTR;
-        prev_meta_ptr = 0;
-        data_ptr = log->ld_header->data_ptr;
-    }
-    
     // Create new channel
-    LDChannel* ld_channel = (LDChannel*)malloc(sizeof(LDChannel));
-    if (!ld_channel) return -1;
+    LDChannel* ld_channel = (LDChannel*)calloc(1, sizeof(LDChannel));
+    if (!ld_channel) return NULL;
     
-    ld_channel->meta_ptr = meta_ptr;
-    ld_channel->prev_meta_ptr = prev_meta_ptr;
-    ld_channel->next_meta_ptr = meta_ptr + sizeof(LDChannel);
-    ld_channel->data_ptr = data_ptr;
-    ld_channel->data_len = channel->message_count;
+    ld_channel->data_len = sample_count;
     ld_channel->dtype = DTYPE_FLOAT32;
-    ld_channel->freq = (int)channel_avg_frequency(channel);
+    ld_channel->freq = freq;
     ld_channel->shift = 0;
     ld_channel->mul = 1;
     ld_channel->scale = 1;
     ld_channel->dec = 0;
-    strncpy(ld_channel->name, channel->name, sizeof(ld_channel->name)-1);
-    strncpy(ld_channel->unit, channel->units, sizeof(ld_channel->unit)-1);
+    strncpy(ld_channel->name, name, sizeof(ld_channel->name)-1);
+    strncpy(ld_channel->unit, units, sizeof(ld_channel->unit)-1);
+    ld_channel->data = NULL;
     
-    // Copy channel data
-    ld_channel->data = malloc(channel->message_count * sizeof(float));
-    if (!ld_channel->data) {
-        free(ld_channel);
-        return -1;
-    }
+    log->sources[log->channel_count] = NULL;
+    log->ld_channels[log->channel_count++] = ld_channel;
+    return ld_channel;
+}
+
+static size_t channel_element_size(const LDChannel* channel) {
+    return (channel->dtype == DTYPE_FLOAT16 || channel->dtype == DTYPE_INT16) ? 2 : 4;
+}
+
+int motec_log_add_channel(MotecLog* log, Channel* channel) {
+    if (!log || !channel) return -1;
+
+    LDChannel* ld_channel = motec_log_append_channel(log, channel->name, channel->units,
+        (int)channel_avg_frequency(channel), channel->message_count);
+    if (!ld_channel) return -1;
     
-    for (int i = 0; i < channel->message_count; i++) {
-        ((float*)ld_channel->data)[i] = (float)channel->messages[i].value;
-    }
+    // The samples are converted by motec_log_write, straight into their
+    // place in the output
+    log->sources[log->channel_count-1] = channel;
     
-    log->ld_channels[log->channel_count++] = ld_channel;
     return 0;
 }
 
@@ -200,104 +199,477 @@ int motec_log_add_all_channels(MotecLog* log, DataLog* data_log) {
     return 0;
 }
 
+#define ALIGN_UP(n, align) (((n) + (align) - 1) / (align) * (align))
+
+// Lays the file out in one pass: the channel records form a linked list
+// straight after the header blocks and the sample data follows the last one.
+// Every channel's samples start on a multiple of their element size, so the
+// encoders can store straight into a mapped file or the data arena.
+int motec_log_plan_layout(MotecLog* log) {
+    if (!log || !log->ld_header) return -1;
+
+    size_t meta_ptr = HEADER_PTR;
+    size_t data_ptr = ALIGN_UP(HEADER_PTR + (size_t)log->channel_count * LD_CHANNEL_RECORD_SIZE,
+                               sizeof(float));
+    log->ld_header->meta_ptr = HEADER_PTR;
+    log->ld_header->data_ptr = (int)data_ptr;
+
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        int last = i == log->channel_count - 1;
+
+        chan->meta_ptr = (int)meta_ptr;
+        chan->prev_meta_ptr = i > 0 ? (int)(meta_ptr - LD_CHANNEL_RECORD_SIZE) : 0;
+        chan->next_meta_ptr = last ? 0 : (int)(meta_ptr + LD_CHANNEL_RECORD_SIZE);
+
+        size_t element_size = channel_element_size(chan);
+        data_ptr = ALIGN_UP(data_ptr, element_size);
+        chan->data_ptr = (int)data_ptr;
+
+        meta_ptr += LD_CHANNEL_RECORD_SIZE;
+        data_ptr += (size_t)chan->data_len * element_size;
+
+        // Offsets are stored as 32 bit ints
+        if (data_ptr > INT_MAX) return -1;
+    }
+
+    log->file_size = data_ptr;
+    return 0;
+}
+
+// Header blocks and channel records into a zeroed image of the planned layout
+static void encode_metadata_image(MotecLog* log, char* image) {
+    encode_ld_header(log->ld_header, image);
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        encode_ld_channel(chan, image + chan->meta_ptr);
+    }
+}
+
+// Everything in front of the sample data, header blocks and channel
+// records, preformatted into one buffer of header->data_ptr bytes
+char* motec_log_encode_metadata(MotecLog* log, size_t* size) {
+    if (!log || !size || motec_log_plan_layout(log) != 0) return NULL;
+
+    *size = (size_t)log->ld_header->data_ptr;
+    char* image = calloc(1, *size);
+    if (!image) return NULL;
+
+    encode_metadata_image(log, image);
+    return image;
+}
+
+int motec_log_write_metadata(MotecLog* log, FILE* f) {
+    if (!log || !f) return -1;
+
+    size_t size;
+    char* image = motec_log_encode_metadata(log, &size);
+    if (!image) return -1;
+
+    int result = 0;
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(image, 1, size, f) != size) result = -1;
+    free(image);
+    return result;
+}
+
+// writev until every byte is out, short writes just advance the vectors
+static int write_vectors(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const char* data, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// A run of one channel's samples, encoded and written by a single task
+typedef struct {
+    int channel;
+    size_t first;
+    size_t count;
+} WriteBlock;
+
+typedef struct {
+    MotecLog* log;
+    WriteBlock* blocks;
+    int fd;                 // -1 to only encode
+    atomic_int failed;
+} WriteJob;
+
+static void channel_encoding(const LDChannel* chan, LdEncoding* enc) {
+    enc->dtype = chan->dtype;
+    enc->shift = chan->shift;
+    enc->mul = chan->mul;
+    enc->scale = chan->scale;
+    enc->dec = chan->dec;
+}
+
+static void write_block(void* ctx, size_t index) {
+    WriteJob* job = (WriteJob*)ctx;
+    WriteBlock* block = &job->blocks[index];
+    LDChannel* chan = job->log->ld_channels[block->channel];
+    const Channel* source = job->log->sources[block->channel];
+    size_t element_size = channel_element_size(chan);
+
+    char* data = (char*)chan->data + block->first * element_size;
+    if (source) {
+        LdEncoding enc;
+        channel_encoding(chan, &enc);
+        ld_encode(data, source->values + block->first, block->count, &enc);
+    }
+
+    if (job->fd >= 0) {
+        off_t offset = (off_t)chan->data_ptr + (off_t)(block->first * element_size);
+        if (pwrite_all(job->fd, data, block->count * element_size, offset) != 0) {
+            atomic_store(&job->failed, 1);
+        }
+    }
+}
+
+// Splits every channel into blocks so a few long channels spread over the
+// pool as well as many short ones. With fd >= 0 each block is also written
+// at its final offset as soon as it is encoded.
+static int encode_channels(MotecLog* log, int fd) {
+    size_t block_count = 0;
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        if (!chan->data) continue;
+        if (fd < 0 && !log->sources[i]) continue;
+        block_count += ((size_t)chan->data_len + WRITE_BLOCK_SAMPLES - 1) / WRITE_BLOCK_SAMPLES;
+    }
+    if (block_count == 0) return 0;
+
+    WriteJob job;
+    job.log = log;
+    job.fd = fd;
+    atomic_init(&job.failed, 0);
+    job.blocks = malloc(sizeof(WriteBlock) * block_count);
+    if (!job.blocks) return -1;
+
+    size_t n = 0;
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        if (!chan->data) continue;
+        if (fd < 0 && !log->sources[i]) continue;
+        for (size_t first = 0; first < (size_t)chan->data_len; first += WRITE_BLOCK_SAMPLES) {
+            size_t left = (size_t)chan->data_len - first;
+            job.blocks[n].channel = i;
+            job.blocks[n].first = first;
+            job.blocks[n].count = left < WRITE_BLOCK_SAMPLES ? left : WRITE_BLOCK_SAMPLES;
+            n++;
+        }
+    }
+
+    thread_pool_parallel_for(thread_pool_default(), block_count, write_block, &job);
+    free(job.blocks);
+    return atomic_load(&job.failed) ? -1 : 0;
+}
+
+static void choose_channel_encoding(void* ctx, size_t index) {
+    MotecLog* log = (MotecLog*)ctx;
+    LDChannel* chan = log->ld_channels[index];
+    const Channel* source = log->sources[index];
+    if (!source) return;
+
+    LdEncoding enc;
+    ld_choose_encoding(source->values, (size_t)chan->data_len, source->decimals,
+                       log->max_error, &enc);
+    chan->dtype = enc.dtype;
+    chan->shift = enc.shift;
+    chan->mul = enc.mul;
+    chan->scale = enc.scale;
+    chan->dec = enc.dec;
+}
+
+// Compact mode picks every channel's encoding from its values before the
+// layout is planned, the record sizes depend on it
+static void choose_encodings(MotecLog* log) {
+    if (!log->compact || log->channel_count == 0) return;
+    thread_pool_parallel_for(thread_pool_default(), (size_t)log->channel_count,
+                             choose_channel_encoding, log);
+}
+
+// Points every channel's data at its place in a copy of the file's data
+// section, wherever that lives
+static int bind_channel_data(MotecLog* log, char* data_section) {
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        if (chan->data_len > 0 && !log->sources[i]) return -1;
+        chan->data = data_section + (chan->data_ptr - log->ld_header->data_ptr);
+    }
+    return 0;
+}
+
+// Zeroes the alignment padding in front of every channel, which no
+// encoder writes
+static void clear_padding(MotecLog* log, char* data_section) {
+    size_t end = (size_t)log->ld_header->data_ptr;
+    for (int i = 0; i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        size_t start = (size_t)chan->data_ptr;
+        if (start > end) memset(data_section + (end - log->ld_header->data_ptr), 0, start - end);
+        end = start + (size_t)chan->data_len * channel_element_size(chan);
+    }
+}
+
+static void unbind_channel_data(MotecLog* log) {
+    for (int i = 0; i < log->channel_count; i++) {
+        log->ld_channels[i]->data = NULL;
+    }
+}
+
+// Encodes into the data arena and writes it behind the metadata image
+static int write_buffered(MotecLog* log, int fd) {
+    size_t meta_size;
+    char* image = motec_log_encode_metadata(log, &meta_size);
+    if (!image) return -1;
+
+    size_t data_size = log->file_size - meta_size;
+    char* arena = realloc(log->data_arena, data_size ? data_size : 1);
+    if (!arena) {
+        free(image);
+        return -1;
+    }
+    log->data_arena = arena;
+    log->data_size = data_size;
+    clear_padding(log, arena);
+
+    int result = bind_channel_data(log, arena);
+    if (result != 0) {
+        free(image);
+        return -1;
+    }
+
+    if (thread_pool_size(thread_pool_default()) > 1) {
+        // Channels are encoded and written concurrently at their offsets
+        result = pwrite_all(fd, image, meta_size, 0);
+        if (result == 0) result = encode_channels(log, fd);
+    } else {
+        // One thread gains nothing from interleaving, encode then write
+        // the whole file with a single call
+        result = encode_channels(log, -1);
+
+        struct iovec iov[2];
+        iov[0].iov_base = image;
+        iov[0].iov_len = meta_size;
+        iov[1].iov_base = arena;
+        iov[1].iov_len = data_size;
+        if (result == 0) result = write_vectors(fd, iov, data_size > 0 ? 2 : 1);
+    }
+
+    free(image);
+    return result;
+}
+
+// Encodes a buffer at a time into the engine's write buffers and queues
+// each one as soon as it is full, so encoding carries on while the
+// earlier pieces are being written
+static int write_async(MotecLog* log, int fd) {
+    size_t meta_size;
+    char* image = motec_log_encode_metadata(log, &meta_size);
+    if (!image) return -1;
+
+    IoEngine* io = log->io;
+    int result = 0;
+    for (size_t done = 0; result == 0 && done < meta_size;) {
+        int index;
+        size_t size;
+        char* buffer = io_engine_buffer(io, &index, &size);
+        if (!buffer) {
+            result = -1;
+            break;
+        }
+        if (size > meta_size - done) size = meta_size - done;
+        memcpy(buffer, image + done, size);
+        result = io_engine_write_buffer(io, index, fd, size, (off_t)done);
+        done += size;
+    }
+    free(image);
+
+    for (int i = 0; result == 0 && i < log->channel_count; i++) {
+        LDChannel* chan = log->ld_channels[i];
+        const Channel* source = log->sources[i];
+        if (chan->data_len == 0) continue;
+        if (!source) {
+            result = -1;
+            break;
+        }
+
+        LdEncoding enc;
+        channel_encoding(chan, &enc);
+        size_t element_size = channel_element_size(chan);
+
+        for (size_t first = 0; result == 0 && first < (size_t)chan->data_len;) {
+            int index;
+            size_t size;
+            char* buffer = io_engine_buffer(io, &index, &size);
+            if (!buffer) {
+                result = -1;
+                break;
+            }
+
+            size_t count = (size_t)chan->data_len - first;
+            if (count > size / element_size) count = size / element_size;
+            ld_encode(buffer, source->values + first, count, &enc);
+            result = io_engine_write_buffer(io, index, fd, count * element_size,
+                                            (off_t)chan->data_ptr + (off_t)(first * element_size));
+            first += count;
+        }
+    }
+
+    // Always drain, the buffers may not be reused while writes are queued and
+    // a failed write has to fail this file, not the next one. See io_engine.h
+    // for what this leaves overlapped.
+    if (io_engine_flush(io) != 0) result = -1;
+    return result;
+}
+
+// Sizes the file up front and maps it, the metadata and the encoded
+// samples are produced in place with no intermediate copy or write calls
+static int write_mapped(MotecLog* log, int fd) {
+    if (motec_log_plan_layout(log) != 0) return -1;
+    if (ftruncate(fd, (off_t)log->file_size) != 0) return -1;
+
+    char* map = mmap(NULL, log->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return -1;
+
+    // A fresh file reads as zeros, the same as the buffered image
+    encode_metadata_image(log, map);
+
+    int result = bind_channel_data(log, map + log->ld_header->data_ptr);
+    if (result == 0) result = encode_channels(log, -1);
+    unbind_channel_data(log);
+
+    if (munmap(map, log->file_size) != 0) result = -1;
+    return result;
+}
+
 int motec_log_write(MotecLog* log, const char* filename) {
     if (!log || !filename) return -1;
-    
-    FILE* f = fopen(filename, "wb");
-    if (!f) return -1;
-    
-    if (log->channel_count > 0) {
-        // Zero out final channel pointer
-        log->ld_channels[log->channel_count-1]->next_meta_ptr = 0;
-        
-        // Write header
-        write_ld_header(log->ld_header, f, log->channel_count);
-        
-        // Write channels
-        for (int i = 0; i < log->channel_count; i++) {
-            LDChannel* chan = log->ld_channels[i];
-            fseek(f, chan->meta_ptr, SEEK_SET);
-            write_ld_channel(chan, f, i);
-            
-            fseek(f, chan->data_ptr, SEEK_SET);
-            fwrite(chan->data, sizeof(float), chan->data_len, f);
-        }
+
+    choose_encodings(log);
+
+    int fd = open(filename, (log->map_output ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return -1;
+
+    int result;
+    if (log->map_output) {
+        result = write_mapped(log, fd);
+    } else if (log->io) {
+        result = write_async(log, fd);
     } else {
-        // Write just the header for empty log
-        write_ld_header(log->ld_header, f, 0);
+        result = write_buffered(log, fd);
     }
-    
-    fclose(f);
-    return 0;
+
+    if (close(fd) != 0) result = -1;
+    return result;
+}
+
+static void put_bytes(char** p, const void* src, size_t size) {
+    memcpy(*p, src, size);
+    *p += size;
 }
 
-void write_ld_header(LDHeader* header, FILE* f, int channel_count) {
-    // Write header fields
-    fwrite(&header->meta_ptr, sizeof(int), 1, f);
-    fwrite(&header->data_ptr, sizeof(int), 1, f);
-    fwrite(&header->aux_ptr, sizeof(int), 1, f);
+// Header at the start of the image, the event, venue and vehicle blocks at
+// their own offsets
+void encode_ld_header(const LDHeader* header, char* image) {
+    char* p = image;
+
+    // Header fields
+    put_bytes(&p, &header->meta_ptr, sizeof(int));
+    put_bytes(&p, &header->data_ptr, sizeof(int));
+    put_bytes(&p, &header->aux_ptr, sizeof(int));
     
-    // Write strings
-    fwrite(header->driver, sizeof(char), 64, f);
-    fwrite(header->vehicleid, sizeof(char), 64, f);
-    fwrite(header->venue, sizeof(char), 64, f);
+    // Strings
+    put_bytes(&p, header->driver, 64);
+    put_bytes(&p, header->vehicleid, 64);
+    put_bytes(&p, header->venue, 64);
     
-    // Write datetime
-    fwrite(&header->datetime, sizeof(time_t), 1, f);
+    // Datetime
+    put_bytes(&p, &header->datetime, sizeof(time_t));
     
-    // Write remaining strings
-    fwrite(header->short_comment, sizeof(char), 64, f);
-    fwrite(header->event, sizeof(char), 64, f);
-    fwrite(header->session, sizeof(char), 64, f);
+    // Remaining strings
+    put_bytes(&p, header->short_comment, 64);
+    put_bytes(&p, header->event, 64);
+    put_bytes(&p, header->session, 64);
     
-    // Write auxiliary data if present
+    // Auxiliary data if present
     if (header->aux) {
-        fseek(f, header->aux_ptr, SEEK_SET);
-        fwrite(header->aux->name, sizeof(char), 64, f);
-        fwrite(header->aux->session, sizeof(char), 64, f);
-        fwrite(header->aux->comment, sizeof(char), 1024, f);
-        fwrite(&header->aux->venue_ptr, sizeof(int), 1, f);
+        p = image + header->aux_ptr;
+        put_bytes(&p, header->aux->name, 64);
+        put_bytes(&p, header->aux->session, 64);
+        put_bytes(&p, header->aux->comment, 1024);
+        put_bytes(&p, &header->aux->venue_ptr, sizeof(int));
         
         if (header->aux->venue) {
-            fseek(f, header->aux->venue_ptr, SEEK_SET);
-            fwrite(header->aux->venue->name, sizeof(char), 64, f);
-            fwrite(&header->aux->venue->vehicle_ptr, sizeof(int), 1, f);
+            p = image + header->aux->venue_ptr;
+            put_bytes(&p, header->aux->venue->name, 64);
+            put_bytes(&p, &header->aux->venue->vehicle_ptr, sizeof(int));
             
             if (header->aux->venue->vehicle) {
-                fseek(f, header->aux->venue->vehicle_ptr, SEEK_SET);
-                fwrite(header->aux->venue->vehicle->id, sizeof(char), 64, f);
-                fwrite(&header->aux->venue->vehicle->weight, sizeof(unsigned int), 1, f);
-                fwrite(header->aux->venue->vehicle->type, sizeof(char), 32, f);
-                fwrite(header->aux->venue->vehicle->comment, sizeof(char), 32, f);
+                p = image + header->aux->venue->vehicle_ptr;
+                put_bytes(&p, header->aux->venue->vehicle->id, 64);
+                put_bytes(&p, &header->aux->venue->vehicle->weight, sizeof(unsigned int));
+                put_bytes(&p, header->aux->venue->vehicle->type, 32);
+                put_bytes(&p, header->aux->venue->vehicle->comment, 32);
             }
         }
     }
 }
 
-void write_ld_channel(LDChannel* channel, FILE* f, int channel_index) {
-    // Write channel metadata
-    fwrite(&channel->prev_meta_ptr, sizeof(int), 1, f);
-    fwrite(&channel->next_meta_ptr, sizeof(int), 1, f);
-    fwrite(&channel->data_ptr, sizeof(int), 1, f);
-    fwrite(&channel->data_len, sizeof(int), 1, f);
+// One LD_CHANNEL_RECORD_SIZE record
+void encode_ld_channel(const LDChannel* channel, char* record) {
+    char* p = record;
+
+    // Channel metadata
+    put_bytes(&p, &channel->prev_meta_ptr, sizeof(int));
+    put_bytes(&p, &channel->next_meta_ptr, sizeof(int));
+    put_bytes(&p, &channel->data_ptr, sizeof(int));
+    put_bytes(&p, &channel->data_len, sizeof(int));
     
-    // Write data type information
+    // Data type information
     uint16_t dtype_a = (channel->dtype == DTYPE_FLOAT32 || channel->dtype == DTYPE_FLOAT16) ? 0x07 : 0x00;
     uint16_t dtype = (channel->dtype == DTYPE_FLOAT16 || channel->dtype == DTYPE_INT16) ? 2 : 4;
-    fwrite(&dtype_a, sizeof(uint16_t), 1, f);
-    fwrite(&dtype, sizeof(uint16_t), 1, f);
-    
-    // Write channel properties
-    fwrite(&channel->freq, sizeof(int16_t), 1, f);
-    fwrite(&channel->shift, sizeof(int16_t), 1, f);
-    fwrite(&channel->mul, sizeof(int16_t), 1, f);
-    fwrite(&channel->scale, sizeof(int16_t), 1, f);
-    fwrite(&channel->dec, sizeof(int16_t), 1, f);
-    
-    // Write strings
-    fwrite(channel->name, sizeof(char), 32, f);
-    fwrite(channel->short_name, sizeof(char), 8, f);
-    fwrite(channel->unit, sizeof(char), 12, f);
+    put_bytes(&p, &dtype_a, sizeof(uint16_t));
+    put_bytes(&p, &dtype, sizeof(uint16_t));
+    
+    // Channel properties
+    int16_t props[5] = {
+        (int16_t)channel->freq, (int16_t)channel->shift, (int16_t)channel->mul,
+        (int16_t)channel->scale, (int16_t)channel->dec
+    };
+    put_bytes(&p, props, sizeof(props));
+    
+    // Strings
+    put_bytes(&p, channel->name, 32);
+    put_bytes(&p, channel->short_name, 8);
+    put_bytes(&p, channel->unit, 12);
 }
 
 
@@ -3,6 +3,7 @@
 
 #include "ldparser.h"
 #include "data_log.h"
+#include "io_engine.h"
 #include <time.h>
 
 // Constants for file pointers
@@ -11,6 +12,9 @@
 #define EVENT_PTR 8180
 #define HEADER_PTR 11336
 
+// Bytes encode_ld_channel puts on disk for one channel's metadata
+#define LD_CHANNEL_RECORD_SIZE 82
+
 typedef struct {
     char driver[64];
     char vehicle_id[64];
@@ -29,17 +33,43 @@ typedef struct {
     LDChannel** ld_channels;
     int channel_count;
     int channel_capacity;
+
+    // Sample data of every channel back to back in file order, the
+    // channels' data pointers point into it once written
+    char* data_arena;
+    size_t data_size;
+    size_t file_size;       // Set by motec_log_plan_layout
+
+    // Write by mapping the output file and encoding straight into it
+    int map_output;
+
+    // Write through this engine's buffers when set, not owned by the log
+    IoEngine* io;
+
+    // Store channels in the smallest encoding that keeps their values, or
+    // that keeps them within max_error when that is above 0
+    int compact;
+    double max_error;
+
+    // Per channel DataLog values. Encoding waits for motec_log_write, so
+    // the DataLog has to outlive it.
+    const Channel** sources;
 } MotecLog;
 
 // Function declarations
 MotecLog* motec_log_create(void);
 void motec_log_free(MotecLog* log);
 int motec_log_initialize(MotecLog* log);
+LDChannel* motec_log_append_channel(MotecLog* log, const char* name, const char* units,
+                                   int freq, int sample_count);
 int motec_log_add_channel(MotecLog* log, Channel* channel);
 int motec_log_add_all_channels(MotecLog* log, DataLog* data_log);
+int motec_log_plan_layout(MotecLog* log);
 int motec_log_write(MotecLog* log, const char* filename);
-void write_ld_header(LDHeader* header, FILE* f, int channel_count);
-void write_ld_channel(LDChannel* channel, FILE* f, int channel_index);
+int motec_log_write_metadata(MotecLog* log, FILE* f);
+char* motec_log_encode_metadata(MotecLog* log, size_t* size);
+void encode_ld_header(const LDHeader* header, char* image);
+void encode_ld_channel(const LDChannel* channel, char* record);
 
 void motec_log_set_metadata(MotecLog* log, 
                            const char* driver,
@@ -1,7 +1,14 @@
 #include "motec_log_generator.h"
+#include "motec_stream.h"
+#include "motec_pipeline.h"
+#include "motec_batch.h"
+#include "dbc_cache.h"
+#include "thread_pool.h"
+#include <stdarg.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #define DEFAULT_FREQUENCY 20.0
 
@@ -34,6 +41,7 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
         {"output", required_argument, 0, 'o'},
         {"frequency", required_argument, 0, 'f'},
         {"dbc", required_argument, 0, 'd'},
+        {"dbc_cache", required_argument, 0, 'k'},
         {"driver", required_argument, 0, 'r'},
         {"vehicle_id", required_argument, 0, 'v'},
         {"vehicle_weight", required_argument, 0, 'w'},
@@ -44,16 +52,27 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
         {"event_session", required_argument, 0, 's'},
         {"long_comment", required_argument, 0, 'l'},
         {"short_comment", required_argument, 0, 'h'},
+        {"threads", required_argument, 0, 'j'},
+        {"stream", no_argument, 0, 'S'},
+        {"pipeline", no_argument, 0, 'P'},
+        {"memory_budget", required_argument, 0, 'm'},
+        {"mmap_output", no_argument, 0, 'M'},
+        {"compact", no_argument, 0, 'C'},
+        {"max_error", required_argument, 0, 'E'},
+        {"batch", no_argument, 0, 'B'},
+        {"io_uring", no_argument, 0, 'U'},
+        {"stats", required_argument, 0, 'T'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "o:f:d:r:v:w:t:c:n:e:s:l:h:", 
+    while ((opt = getopt_long(argc, argv, "o:f:d:k:r:v:w:t:c:n:e:s:l:h:j:SPm:MCE:BUT:", 
                              long_options, NULL)) != -1) {
         switch (opt) {
             case 'o': args->output_path = strdup(optarg); break;
             case 'f': args->frequency = atof(optarg); break;
             case 'd': args->dbc_path = strdup(optarg); break;
+            case 'k': args->dbc_cache = strdup(optarg); break;
             case 'r': args->driver = strdup(optarg); break;
             case 'v': args->vehicle_id = strdup(optarg); break;
             case 'w': args->vehicle_weight = atoi(optarg); break;
@@ -64,6 +83,16 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
             case 's': args->event_session = strdup(optarg); break;
             case 'l': args->long_comment = strdup(optarg); break;
             case 'h': args->short_comment = strdup(optarg); break;
+            case 'j': args->threads = atoi(optarg); break;
+            case 'S': args->stream = 1; break;
+            case 'P': args->pipeline = 1; break;
+            case 'm': args->memory_budget = atoi(optarg); break;
+            case 'M': args->mmap_output = 1; break;
+            case 'C': args->compact = 1; break;
+            case 'E': args->compact = 1; args->max_error = atof(optarg); break;
+            case 'B': args->batch = 1; break;
+            case 'U': args->io_uring = 1; break;
+            case 'T': args->stats_path = strdup(optarg); break;
             default: return -1;
         }
     }
@@ -92,6 +121,13 @@ int parse_arguments(int argc, char** argv, GeneratorArgs* args) {
         return -1;
     }
 
+    // Streamed CSV channels are written as float32 before all their values
+    // are known, there is nothing to pick a compact encoding from
+    if (args->compact && (args->stream || args->pipeline) && args->log_type == LOG_TYPE_CSV) {
+        printf("ERROR: --compact and --max_error cannot be used with --stream or --pipeline\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -115,41 +151,192 @@ char* get_output_filename(const char* input_path, const char* output_path) {
     }
 }
 
+// Progress lines, left out for the files of a batch where they would
+// interleave and when the --stats JSON goes to stdout
+static void progress(const GeneratorArgs* args, const char* format, ...) {
+    if (args->quiet) return;
+
+    va_list ap;
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+}
+
+// Creates the directory the output file goes in if needed
+static void create_output_dir(const GeneratorArgs* args, const char* output_filename) {
+    char* path = strdup(output_filename);
+    char* output_dir = dirname(path);
+    
+    struct stat st = {0};
+    if (stat(output_dir, &st) == -1) {
+        progress(args, "Directory '%s' does not exist, will create it\n", output_dir);
+        mkdir(output_dir, 0700);
+    }
+    free(path);
+}
+
+static void set_motec_metadata(MotecLog* motec_log, const GeneratorArgs* args) {
+    motec_log_set_metadata(motec_log, 
+                          args->driver,
+                          args->vehicle_id,
+                          args->vehicle_weight,
+                          args->vehicle_type,
+                          args->vehicle_comment,
+                          args->venue_name,
+                          args->event_name,
+                          args->event_session,
+                          args->long_comment,
+                          args->short_comment);
+}
+
+static void print_pipeline_stats(const GeneratorArgs* args, const PipelineStats* stats) {
+    progress(args, "Pipeline with %d parsers:\n", stats->parsers);
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        const PipelineStageStats* stage = &stats->stages[i];
+        progress(args, "  %-6s %8llu blocks %10.1f MiB  queue max %zu mean %.1f"
+                 "  starved %llu (%.3fs)  blocked %llu (%.3fs)\n",
+                 pipeline_stage_name((PipelineStage)i),
+                 (unsigned long long)stage->blocks, (double)stage->bytes / (1 << 20),
+                 stage->max_depth, stage->mean_depth,
+                 (unsigned long long)stage->input_waits, stage->input_wait_seconds,
+                 (unsigned long long)stage->output_waits, stage->output_wait_seconds);
+    }
+}
+
+static uint64_t file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Samples in the longest channel
+static uint64_t datalog_rows(const DataLog* log) {
+    size_t rows = 0;
+    for (size_t i = 0; i < log->channel_count; i++) {
+        if (log->channels[i]->message_count > rows) rows = log->channels[i]->message_count;
+    }
+    return rows;
+}
+
+// CSV to .ld without holding the log in memory, see motec_log_stream_csv and
+// motec_log_pipeline_csv
+static int stream_log_file(const GeneratorArgs* args) {
+    progress(args, args->pipeline ? "Streaming log through pipeline...\n" : "Streaming log...\n");
+
+    RunStatsMark mark;
+    run_stats_begin(args->stats, &mark, NULL);
+
+    MotecLog* motec_log = motec_log_create();
+    if (!motec_log) return -1;
+
+    set_motec_metadata(motec_log, args);
+    motec_log_initialize(motec_log);
+
+    char* output_filename = get_output_filename(args->log_path, args->output_path);
+    create_output_dir(args, output_filename);
+
+    size_t budget = args->memory_budget > 0 ?
+        (size_t)args->memory_budget << 20 : (size_t)DEFAULT_MEMORY_BUDGET;
+    int result;
+    PipelineStats stats;
+    if (args->pipeline) {
+        int threads = args->threads > 0 ? args->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        result = motec_log_pipeline_csv(motec_log, args->log_path, output_filename,
+                                        args->frequency, budget, threads, &stats);
+    } else {
+        result = motec_log_stream_csv(motec_log, args->log_path, output_filename,
+                                      args->frequency, budget);
+    }
+
+    if (result != 0) {
+        printf("ERROR: Failed to stream log file: %s\n", args->log_path);
+    } else if (motec_log->channel_count == 0) {
+        printf("ERROR: Failed to find any channels in log data\n");
+        result = -1;
+    } else {
+        progress(args, "Wrote %d channels of %d samples\n", motec_log->channel_count,
+                 motec_log->ld_channels[0]->data_len);
+        if (args->pipeline) print_pipeline_stats(args, &stats);
+    }
+
+    if (result == 0) {
+        run_stats_end(args->stats, RUN_STAGE_STREAM, &mark, NULL, file_size(output_filename),
+                      (uint64_t)motec_log->ld_channels[0]->data_len);
+        if (args->pipeline) run_stats_set_pipeline(args->stats, &stats);
+    }
+
+    free(output_filename);
+    motec_log_free(motec_log);
+
+    if (result == 0) {
+        progress(args, "Done!\n");
+    }
+    return result;
+}
+
+// The whole log in memory, mapped or read through the I/O engine. A batch
+// may have started the engine read while converting the previous log.
+static int read_log_file(const GeneratorArgs* args, MappedFile* map) {
+    if (args->io) {
+        IoRead* read = args->input ? args->input : io_engine_start_read(args->io, args->log_path);
+        return read ? io_engine_finish_read(args->io, read, map) : -1;
+    }
+
+    FILE* f = fopen(args->log_path, "r");
+    if (!f) return -1;
+
+    int result = mapped_file_from_stream(map, f);
+    fclose(f);
+    return result;
+}
+
 int process_log_file(const GeneratorArgs* args) {
-    printf("Loading log...\n");
+    if ((args->stream || args->pipeline) && args->log_type == LOG_TYPE_CSV) {
+        return stream_log_file(args);
+    }
+
+    progress(args, "Loading log...\n");
     
     // Read input file
-    FILE* f = fopen(args->log_path, "r");
-    if (!f) {
+    RunStatsMark mark;
+    run_stats_begin(args->stats, &mark, NULL);
+    MappedFile map;
+    if (read_log_file(args, &map) != 0) {
         printf("ERROR: Cannot open log file: %s\n", args->log_path);
         return -1;
     }
+    uint64_t input_size = map.size;
+    run_stats_end(args->stats, RUN_STAGE_LOAD, &mark, NULL, input_size, 0);
 
     // Create data log
     DataLog* data_log = datalog_create(""); 
     if (!data_log) {
-        fclose(f);
+        mapped_file_close(&map);
         return -1;
     }
 
     // Process based on log type
+    run_stats_begin(args->stats, &mark, &data_log->arena);
     int result = 0;
     switch (args->log_type) {
         case LOG_TYPE_CAN:
-            if (args->dbc_path) {
-                printf("Loading DBC...\n");
-                result = datalog_from_can_log(data_log, f, args->dbc_path);
+            if (args->dbc) {
+                result = datalog_from_can_buffer(data_log, map.data, map.size, args->dbc);
+            } else if (args->dbc_path) {
+                progress(args, "Loading DBC...\n");
+                Dbc* dbc = dbc_load_cached(args->dbc_path, args->dbc_cache);
+                result = dbc ? datalog_from_can_buffer(data_log, map.data, map.size, dbc) : -1;
+                dbc_free(dbc);
             }
             break;
         case LOG_TYPE_CSV:
-            result = datalog_from_csv_log(data_log, f);
+            result = datalog_from_csv_buffer(data_log, map.data, map.size);
             break;
         case LOG_TYPE_ACCESSPORT:
-            result = datalog_from_accessport_log(data_log, f);
+            result = datalog_from_accessport_buffer(data_log, map.data, map.size);
             break;
     }
 
-    fclose(f);
+    mapped_file_close(&map);
 
     if (result != 0 || datalog_channel_count(data_log) == 0) {
         printf("ERROR: Failed to find any channels in log data\n");
@@ -157,16 +344,32 @@ int process_log_file(const GeneratorArgs* args) {
         datalog_free(data_log);
         return -1;
     }
+    run_stats_end(args->stats, RUN_STAGE_PARSE, &mark, &data_log->arena, input_size,
+                  datalog_rows(data_log));
 
-    printf("Parsed %.1fs log with %d channels:\n",
+    progress(args, "Parsed %.1fs log with %d channels:\n",
        datalog_duration(data_log),  // Returns double
        datalog_channel_count(data_log));
 
     // Print channel info
-    data_log_print_channels(data_log);
+    if (!args->quiet) data_log_print_channels(data_log);
+
+    // Resample every channel onto one fixed rate grid, 0 keeps the native rate
+    if (args->frequency > 0) {
+        run_stats_begin(args->stats, &mark, &data_log->arena);
+        if (datalog_resample(data_log, args->frequency) != 0) {
+            printf("ERROR: Failed to resample log to %.1f Hz\n", args->frequency);
+            datalog_free(data_log);
+            return -1;
+        }
+        uint64_t rows = datalog_rows(data_log);
+        run_stats_end(args->stats, RUN_STAGE_RESAMPLE, &mark, &data_log->arena,
+                      rows * data_log->channel_count * sizeof(double), rows);
+    }
 
     // Create MoTeC log
-    printf("Converting to MoTeC log...\n");
+    progress(args, "Converting to MoTeC log...\n");
+    run_stats_begin(args->stats, &mark, &data_log->arena);
     MotecLog* motec_log = motec_log_create();
     if (!motec_log) {
         datalog_free(data_log);
@@ -174,55 +377,89 @@ int process_log_file(const GeneratorArgs* args) {
     }
 
     // Set metadata
-    motec_log_set_metadata(motec_log, 
-                          args->driver,
-                          args->vehicle_id,
-                          args->vehicle_weight,
-                          args->vehicle_type,
-                          args->vehicle_comment,
-                          args->venue_name,
-                          args->event_name,
-                          args->event_session,
-                          args->long_comment,
-                          args->short_comment);
+    set_motec_metadata(motec_log, args);
+    motec_log->map_output = args->mmap_output;
+    motec_log->io = args->io;
+    motec_log->compact = args->compact;
+    motec_log->max_error = args->max_error;
 
     motec_log_initialize(motec_log);
     motec_log_add_all_channels(motec_log, data_log);
+    run_stats_end(args->stats, RUN_STAGE_BUILD, &mark, &data_log->arena,
+                  datalog_rows(data_log) * data_log->channel_count * sizeof(double),
+                  datalog_rows(data_log));
 
     // Get output filename and create directory if needed
     char* output_filename = get_output_filename(args->log_path, args->output_path);
-    char* output_dir = dirname(strdup(output_filename));
-    
-    struct stat st = {0};
-    if (stat(output_dir, &st) == -1) {
-        printf("Directory '%s' does not exist, will create it\n", output_dir);
-        mkdir(output_dir, 0700);
-    }
+    create_output_dir(args, output_filename);
 
     // Write output file
-    printf("Saving MoTeC log...\n");
+    progress(args, "Saving MoTeC log...\n");
+    run_stats_begin(args->stats, &mark, NULL);
     result = motec_log_write(motec_log, output_filename);
+    if (result == 0) {
+        run_stats_end(args->stats, RUN_STAGE_WRITE, &mark, NULL, file_size(output_filename),
+                      datalog_rows(data_log));
+    }
 
     // Cleanup
     free(output_filename);
-    free(output_dir);
     motec_log_free(motec_log);
     datalog_free(data_log);
 
     if (result == 0) {
-        printf("Done!\n");
+        progress(args, "Done!\n");
     }
     return result;
 }
 
+int process_batch(GeneratorArgs* args) {
+    char** paths;
+    size_t count;
+    if (batch_collect_inputs(args->log_path, &paths, &count) != 0) {
+        printf("ERROR: Cannot read batch input: %s\n", args->log_path);
+        return -1;
+    }
+    if (count == 0) {
+        printf("ERROR: No logs found in %s\n", args->log_path);
+        batch_free_inputs(paths, count);
+        return -1;
+    }
+
+    // Options and the DBC are loaded once for the whole batch
+    Dbc* dbc = NULL;
+    if (args->log_type == LOG_TYPE_CAN) {
+        progress(args, "Loading DBC...\n");
+        dbc = dbc_load_cached(args->dbc_path, args->dbc_cache);
+        if (!dbc) {
+            printf("ERROR: Cannot load DBC file: %s\n", args->dbc_path);
+            batch_free_inputs(paths, count);
+            return -1;
+        }
+    }
+
+    progress(args, "Converting %zu logs...\n", count);
+    RunStatsMark mark;
+    run_stats_begin(args->stats, &mark, NULL);
+    args->dbc = dbc;
+    int failed = batch_convert(args, paths, count);
+    args->dbc = NULL;
+    run_stats_end(args->stats, RUN_STAGE_BATCH, &mark, NULL, 0, count);
+
+    dbc_free(dbc);
+    batch_free_inputs(paths, count);
+    return failed == 0 ? 0 : -1;
+}
+
 void print_usage(void) {
     printf("%s\n\n", DESCRIPTION);
     printf("Usage: motec_log_generator <log> <log_type> [options]\n");
     printf("Log types: CAN, CSV, ACCESSPORT\n\n");
     printf("Options:\n");
-    printf("  --output <file>        Output filename\n");
-    printf("  --frequency <hz>       Fixed frequency to resample channels\n");
+    printf("  --output <file>        Output filename, or output directory with --batch\n");
+    printf("  --frequency <hz>       Fixed frequency to resample channels, 0 keeps the log's rate\n");
     printf("  --dbc <file>          DBC file (required for CAN logs)\n");
+    printf("  --dbc_cache <file>     Parsed DBC cache, rebuilt whenever the DBC changes\n");
     printf("  --driver <str>         Driver name\n");
     printf("  --vehicle_id <str>     Vehicle ID\n");
     printf("  --vehicle_weight <n>   Vehicle weight\n");
@@ -231,7 +468,20 @@ void print_usage(void) {
     printf("  --event_name <str>     Event name\n");
     printf("  --event_session <str>  Event session\n");
     printf("  --long_comment <str>   Long comment\n");
-    printf("  --short_comment <str>  Short comment\n\n");
+    printf("  --short_comment <str>  Short comment\n");
+    printf("  --threads <n>          Worker threads, defaults to one per CPU\n");
+    printf("  --stream               Convert CSV logs in bounded memory without loading them\n");
+    printf("  --pipeline             Like --stream with reading, parsing, encoding and writing\n");
+    printf("                         running at once, prints how long each stage waited\n");
+    printf("  --memory_budget <MiB>  Sample memory used by --stream, defaults to 64\n");
+    printf("  --mmap_output          Write the .ld file through a memory mapping\n");
+    printf("  --compact              Store channels as int16/int32/float16 where values allow,\n");
+    printf("                         not with --stream or --pipeline for CSV logs\n");
+    printf("  --max_error <value>    Compact encoding may round values by up to this much\n");
+    printf("  --batch                <log> is a directory, glob or list file of logs to convert\n");
+    printf("  --io_uring             Read logs and write .ld files asynchronously through io_uring\n");
+    printf("  --stats <file>         Write time, CPU, bytes, rows, allocations and peak memory of\n");
+    printf("                         each stage as JSON, - for stdout\n\n");
     printf("%s\n", EPILOG);
 }
 
@@ -239,6 +489,7 @@ void free_arguments(GeneratorArgs* args) {
     free(args->log_path);
     free(args->output_path);
     free(args->dbc_path);
+    free(args->dbc_cache);
     free(args->driver);
     free(args->vehicle_id);
     free(args->vehicle_type);
@@ -248,6 +499,7 @@ void free_arguments(GeneratorArgs* args) {
     free(args->event_session);
     free(args->long_comment);
     free(args->short_comment);
+    free(args->stats_path);
 }
 
 int main(int argc, char** argv) {
@@ -256,7 +508,47 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    int result = process_log_file(&args);
+    thread_pool_set_default_threads(args.threads);
+
+    // Batch workers each set up their own engine
+    if (args.io_uring && !args.batch) args.io = io_engine_create();
+
+    RunStats stats;
+    int json_stdout = -1;
+    if (args.stats_path) {
+        run_stats_init(&stats);
+        args.stats = &stats;
+
+        // Keep stdout to the JSON alone, no progress and errors go to stderr
+        // until it is written
+        if (strcmp(args.stats_path, "-") == 0) {
+            args.quiet = 1;
+            fflush(stdout);
+            json_stdout = dup(STDOUT_FILENO);
+            if (json_stdout >= 0) dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+    }
+
+    int result = args.batch ? process_batch(&args) : process_log_file(&args);
+
+    if (args.stats) {
+        static const char* LOG_TYPES[] = {"CAN", "CSV", "ACCESSPORT"};
+        char* output_filename = args.batch ? NULL :
+            get_output_filename(args.log_path, args.output_path);
+        const char* output = args.batch ? args.output_path : output_filename;
+        if (json_stdout >= 0) {
+            fflush(stdout);
+            dup2(json_stdout, STDOUT_FILENO);
+            close(json_stdout);
+        }
+        if (run_stats_write_json(&stats, args.stats_path, args.log_path, output,
+                                 LOG_TYPES[args.log_type], result) != 0) {
+            printf("ERROR: Cannot write stats: %s\n", args.stats_path);
+        }
+        free(output_filename);
+    }
+    io_engine_destroy(args.io);
     free_arguments(&args);
+    thread_pool_shutdown_default();
     return result;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "data_log.h"
 #include "motec_log.h"
+#include "run_stats.h"
 
 // Log types
 typedef enum {
@@ -21,6 +22,22 @@ typedef struct {
     char* output_path;
     float frequency;
     char* dbc_path;
+    char* dbc_cache;        // Binary cache of the parsed DBC
+    int threads;
+    int stream;
+    int pipeline;           // Streaming conversion split into concurrent stages
+    int memory_budget;      // MiB of sample buffers for streaming conversion
+    int mmap_output;
+    int compact;
+    double max_error;       // Largest rounding --compact may introduce
+    int batch;              // log_path names a batch of logs
+    int quiet;              // No progress output, set for the files of a batch and --stats -
+    const Dbc* dbc;         // Loaded once and shared by a batch of CAN logs
+    int io_uring;
+    IoEngine* io;           // Asynchronous reads and writes when set
+    IoRead* input;          // Read of log_path already started on io
+    char* stats_path;       // JSON stage timings written here, "-" for stdout
+    RunStats* stats;        // Filled in by process_log_file when set
     
     // Motec log metadata
     char* driver;
@@ -39,6 +56,7 @@ typedef struct {
 int parse_arguments(int argc, char** argv, GeneratorArgs* args);
 char* get_output_filename(const char* input_path, const char* output_path);
 int process_log_file(const GeneratorArgs* args);
+int process_batch(GeneratorArgs* args);
 void print_usage(void);
 void free_arguments(GeneratorArgs* args);
 
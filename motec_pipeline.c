@@ -0,0 +1,579 @@
+#include "motec_pipeline.h"
+#include "motec_stream.h"
+#include "csv_parser.h"
+#include "spsc_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define PIPELINE_TEXT_BLOCK_SIZE (1 << 20)
+#define PIPELINE_LANE_BLOCKS 4          // Text and row blocks per parser
+#define PIPELINE_COLUMN_BLOCKS 3        // Filling, queued and being written
+#define PIPELINE_MIN_BLOCK_SAMPLES 1024
+#define PIPELINE_MAX_PARSERS 64
+
+// Whole lines of the input
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextBlock;
+
+// Parsed rows, values row by row with a flag for every cell that had a number
+typedef struct {
+    size_t rows;
+    size_t capacity;
+    double* timestamps;
+    float* values;
+    unsigned char* present;
+} RowBlock;
+
+// The next block_size samples of every channel, channel after channel
+typedef struct {
+    float* samples;
+    size_t first;
+    size_t fill;
+} ColumnBlock;
+
+struct Pipeline;
+
+// One parser and the rings that connect it to the reader and the encoder.
+// Blocks are dealt to lanes round robin so taking them back in the same
+// order keeps the rows in file order.
+typedef struct {
+    struct Pipeline* pipeline;
+    pthread_t thread;
+    SpscRing text;          // Reader to parser
+    SpscRing text_free;     // Parser back to reader
+    SpscRing rows;          // Parser to encoder
+    SpscRing rows_free;     // Encoder back to parser
+    TextBlock text_blocks[PIPELINE_LANE_BLOCKS];
+    RowBlock row_blocks[PIPELINE_LANE_BLOCKS];
+    uint64_t blocks;
+    uint64_t bytes;
+} PipelineLane;
+
+typedef struct Pipeline {
+    MotecLog* log;
+    int in_fd;
+    int out_fd;
+    off_t data_offset;
+    size_t channel_count;
+    size_t sample_count;
+    double first_timestamp;
+    double step;
+    PipelineLane* lanes;
+    int lane_count;
+    SpscRing columns;       // Encoder to writer
+    SpscRing columns_free;  // Writer back to encoder
+    ColumnBlock column_blocks[PIPELINE_COLUMN_BLOCKS];
+    size_t block_size;
+    atomic_int failed;
+    uint64_t read_blocks;
+    uint64_t read_bytes;
+    uint64_t encode_blocks;
+    uint64_t write_blocks;
+    uint64_t write_bytes;
+} Pipeline;
+
+static const char* STAGE_NAMES[PIPELINE_STAGE_COUNT] = {"read", "parse", "encode", "write"};
+
+const char* pipeline_stage_name(PipelineStage stage) {
+    return stage < PIPELINE_STAGE_COUNT ? STAGE_NAMES[stage] : "";
+}
+
+static void pipeline_fail(Pipeline* pipeline) {
+    atomic_store(&pipeline->failed, 1);
+}
+
+static int grow_text_block(TextBlock* block, size_t capacity) {
+    if (capacity <= block->capacity) return 0;
+    char* data = realloc(block->data, capacity);
+    if (!data) return -1;
+    block->data = data;
+    block->capacity = capacity;
+    return 0;
+}
+
+static int grow_row_block(RowBlock* block, size_t channel_count) {
+    size_t capacity = block->capacity ? block->capacity * 2 : 1024;
+    size_t cells = capacity * (channel_count ? channel_count : 1);
+
+    double* timestamps = realloc(block->timestamps, sizeof(double) * capacity);
+    if (timestamps) block->timestamps = timestamps;
+    float* values = realloc(block->values, sizeof(float) * cells);
+    if (values) block->values = values;
+    unsigned char* present = realloc(block->present, cells);
+    if (present) block->present = present;
+    if (!timestamps || !values || !present) return -1;
+
+    block->capacity = capacity;
+    return 0;
+}
+
+// Fills block past whatever it already holds until it is full or the file
+// ends, reads can come back short
+static int read_text(Pipeline* pipeline, TextBlock* block, off_t* offset, int* eof) {
+    while (block->size < block->capacity) {
+        ssize_t n = pread(pipeline->in_fd, block->data + block->size,
+                          block->capacity - block->size, *offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            *eof = 1;
+            break;
+        }
+        block->size += (size_t)n;
+        *offset += n;
+    }
+    return 0;
+}
+
+// Reader stage: cuts the file into blocks ending on a line break, the
+// partial line at the end of a block starts the next one
+static void* read_stage(void* arg) {
+    Pipeline* pipeline = (Pipeline*)arg;
+    TextBlock carry = {NULL, 0, 0};
+    off_t offset = pipeline->data_offset;
+    int lane = 0;
+    int eof = 0;
+
+    while (!eof) {
+        PipelineLane* target = &pipeline->lanes[lane];
+        TextBlock* block = spsc_ring_pop(&target->text_free);
+
+        block->size = 0;
+        // The reader only consumes text_free, the block is freed with its lane
+        if (grow_text_block(block, carry.size + PIPELINE_TEXT_BLOCK_SIZE) != 0) {
+            pipeline_fail(pipeline);
+            break;
+        }
+        if (carry.size > 0) memcpy(block->data, carry.data, carry.size);
+        block->size = carry.size;
+
+        // A line longer than the block grows it until the line fits
+        size_t keep;
+        for (;;) {
+            if (read_text(pipeline, block, &offset, &eof) != 0) {
+                pipeline_fail(pipeline);
+                eof = 1;
+            }
+            keep = block->size;
+            if (eof) break;
+            while (keep > 0 && block->data[keep - 1] != '\n') keep--;
+            if (keep > 0) break;
+            if (grow_text_block(block, block->capacity * 2) != 0) {
+                pipeline_fail(pipeline);
+                eof = 1;
+            }
+        }
+
+        carry.size = block->size - keep;
+        if (grow_text_block(&carry, carry.size) != 0) {
+            pipeline_fail(pipeline);
+            carry.size = 0;
+            eof = 1;
+        } else if (carry.size > 0) {
+            memcpy(carry.data, block->data + keep, carry.size);
+        }
+        block->size = keep;
+
+        pipeline->read_blocks++;
+        pipeline->read_bytes += keep;
+        spsc_ring_push(&target->text, block);
+        lane = (lane + 1) % pipeline->lane_count;
+    }
+
+    for (int i = 0; i < pipeline->lane_count; i++) {
+        spsc_ring_push(&pipeline->lanes[i].text, NULL);
+    }
+    free(carry.data);
+    return NULL;
+}
+
+static int parse_text_block(Pipeline* pipeline, const TextBlock* text, RowBlock* rows, CsvRow* row) {
+    size_t channel_count = pipeline->channel_count;
+    const char* p = text->data;
+    const char* end = text->data + text->size;
+
+    rows->rows = 0;
+    while (p < end) {
+        p = csv_split_row(p, end, row);
+
+        double timestamp;
+        CsvField* time_field = &row->fields[0];
+        if (!csv_parse_number(time_field->start, time_field->len, &timestamp, NULL)) continue;
+
+        if (rows->rows == rows->capacity && grow_row_block(rows, channel_count) != 0) return -1;
+
+        size_t r = rows->rows++;
+        float* values = rows->values + r * channel_count;
+        unsigned char* present = rows->present + r * channel_count;
+        rows->timestamps[r] = timestamp;
+        for (size_t i = 0; i < channel_count; i++) {
+            double value;
+            present[i] = i + 1 < row->count &&
+                csv_parse_number(row->fields[i + 1].start, row->fields[i + 1].len, &value, NULL);
+            values[i] = present[i] ? (float)value : 0.0f;
+        }
+    }
+    return 0;
+}
+
+// Parser stage: one per lane
+static void* parse_stage(void* arg) {
+    PipelineLane* lane = (PipelineLane*)arg;
+    Pipeline* pipeline = lane->pipeline;
+    CsvRow row;
+    csv_row_init(&row);
+
+    TextBlock* text;
+    while ((text = spsc_ring_pop(&lane->text)) != NULL) {
+        RowBlock* rows = spsc_ring_pop(&lane->rows_free);
+        if (parse_text_block(pipeline, text, rows, &row) != 0) {
+            pipeline_fail(pipeline);
+            rows->rows = 0;
+        }
+        lane->blocks++;
+        lane->bytes += text->size;
+        spsc_ring_push(&lane->text_free, text);
+        spsc_ring_push(&lane->rows, rows);
+    }
+
+    spsc_ring_push(&lane->rows, NULL);
+    csv_row_free(&row);
+    return NULL;
+}
+
+static int write_all(int fd, const void* data, size_t size, off_t offset) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Writer stage: each channel's part of a block goes to its place in the
+// channel's data. After a failure blocks are still taken and handed back so
+// the encoder never waits on a writer that gave up.
+static void* write_stage(void* arg) {
+    Pipeline* pipeline = (Pipeline*)arg;
+
+    ColumnBlock* block;
+    while ((block = spsc_ring_pop(&pipeline->columns)) != NULL) {
+        for (size_t i = 0; i < pipeline->channel_count && !atomic_load(&pipeline->failed); i++) {
+            LDChannel* chan = pipeline->log->ld_channels[i];
+            off_t offset = (off_t)chan->data_ptr + (off_t)(block->first * sizeof(float));
+            if (write_all(pipeline->out_fd, block->samples + i * pipeline->block_size,
+                          block->fill * sizeof(float), offset) != 0) {
+                pipeline_fail(pipeline);
+            }
+        }
+        pipeline->write_blocks++;
+        pipeline->write_bytes += block->fill * sizeof(float) * pipeline->channel_count;
+        spsc_ring_push(&pipeline->columns_free, block);
+    }
+    return NULL;
+}
+
+// Encoder state, lives on the calling thread
+typedef struct {
+    Pipeline* pipeline;
+    float* held;            // Latest value per channel
+    ColumnBlock* block;
+    size_t emitted;
+} Encoder;
+
+// Appends the held values as the next sample of every channel, same as
+// stream_emit in motec_stream.c
+static void encoder_emit(Encoder* encoder) {
+    Pipeline* pipeline = encoder->pipeline;
+    if (encoder->emitted >= pipeline->sample_count) return;
+
+    ColumnBlock* block = encoder->block;
+    for (size_t i = 0; i < pipeline->channel_count; i++) {
+        block->samples[i * pipeline->block_size + block->fill] = encoder->held[i];
+    }
+    block->fill++;
+    encoder->emitted++;
+
+    if (block->fill == pipeline->block_size) {
+        pipeline->encode_blocks++;
+        spsc_ring_push(&pipeline->columns, block);
+        encoder->block = spsc_ring_pop(&pipeline->columns_free);
+        encoder->block->first = encoder->emitted;
+        encoder->block->fill = 0;
+    }
+}
+
+static void encoder_hold(Encoder* encoder, const RowBlock* rows, size_t r) {
+    size_t channel_count = encoder->pipeline->channel_count;
+    const float* values = rows->values + r * channel_count;
+    const unsigned char* present = rows->present + r * channel_count;
+    for (size_t i = 0; i < channel_count; i++) {
+        if (present[i]) encoder->held[i] = values[i];
+    }
+}
+
+static void encode_rows(Encoder* encoder, const RowBlock* rows, size_t* grid_index) {
+    Pipeline* pipeline = encoder->pipeline;
+    for (size_t r = 0; r < rows->rows; r++) {
+        if (pipeline->step > 0.0) {
+            double timestamp = rows->timestamps[r];
+            while (*grid_index < pipeline->sample_count &&
+                   timestamp >= pipeline->first_timestamp + (double)*grid_index * pipeline->step +
+                                0.5 * pipeline->step) {
+                encoder_emit(encoder);
+                (*grid_index)++;
+            }
+            encoder_hold(encoder, rows, r);
+        } else {
+            encoder_hold(encoder, rows, r);
+            encoder_emit(encoder);
+        }
+    }
+}
+
+static void encode_stage(Pipeline* pipeline) {
+    Encoder encoder;
+    encoder.pipeline = pipeline;
+    encoder.held = calloc(pipeline->channel_count ? pipeline->channel_count : 1, sizeof(float));
+    encoder.block = spsc_ring_pop(&pipeline->columns_free);
+    encoder.block->first = 0;
+    encoder.block->fill = 0;
+    encoder.emitted = 0;
+    if (!encoder.held) pipeline_fail(pipeline);
+
+    size_t grid_index = 0;
+    int lane = 0;
+    RowBlock* rows;
+    while ((rows = spsc_ring_pop(&pipeline->lanes[lane].rows)) != NULL) {
+        if (encoder.held) encode_rows(&encoder, rows, &grid_index);
+        spsc_ring_push(&pipeline->lanes[lane].rows_free, rows);
+        lane = (lane + 1) % pipeline->lane_count;
+    }
+
+    // Every other lane is down to its end marker
+    for (int i = 1; i < pipeline->lane_count; i++) {
+        spsc_ring_pop(&pipeline->lanes[(lane + i) % pipeline->lane_count].rows);
+    }
+
+    // Whatever is left of the grid holds the last values
+    while (encoder.held && encoder.emitted < pipeline->sample_count) {
+        encoder_emit(&encoder);
+    }
+    if (encoder.block->fill > 0) {
+        pipeline->encode_blocks++;
+        spsc_ring_push(&pipeline->columns, encoder.block);
+    }
+    spsc_ring_push(&pipeline->columns, NULL);
+    free(encoder.held);
+}
+
+static void free_lane(PipelineLane* lane) {
+    for (int b = 0; b < PIPELINE_LANE_BLOCKS; b++) {
+        free(lane->text_blocks[b].data);
+        free(lane->row_blocks[b].timestamps);
+        free(lane->row_blocks[b].values);
+        free(lane->row_blocks[b].present);
+    }
+    spsc_ring_destroy(&lane->text);
+    spsc_ring_destroy(&lane->text_free);
+    spsc_ring_destroy(&lane->rows);
+    spsc_ring_destroy(&lane->rows_free);
+}
+
+static int init_lane(Pipeline* pipeline, PipelineLane* lane) {
+    memset(lane, 0, sizeof(PipelineLane));
+    lane->pipeline = pipeline;
+
+    // Room for every block plus the end marker, so handing blocks back and
+    // ending the stream never wait
+    if (spsc_ring_init(&lane->text, PIPELINE_LANE_BLOCKS + 1) != 0 ||
+        spsc_ring_init(&lane->text_free, PIPELINE_LANE_BLOCKS + 1) != 0 ||
+        spsc_ring_init(&lane->rows, PIPELINE_LANE_BLOCKS + 1) != 0 ||
+        spsc_ring_init(&lane->rows_free, PIPELINE_LANE_BLOCKS + 1) != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < PIPELINE_LANE_BLOCKS; b++) {
+        if (grow_text_block(&lane->text_blocks[b], PIPELINE_TEXT_BLOCK_SIZE) != 0) return -1;
+        spsc_ring_push(&lane->text_free, &lane->text_blocks[b]);
+        spsc_ring_push(&lane->rows_free, &lane->row_blocks[b]);
+    }
+    return 0;
+}
+
+static void ring_wait_seconds(const SpscRingSide* side, uint64_t* waits, double* seconds) {
+    *waits += side->waits;
+    *seconds += (double)side->wait_ns / 1e9;
+}
+
+static void ring_depth(const SpscRingSide* side, PipelineStageStats* stage, uint64_t* depth_total,
+                       uint64_t* pops) {
+    if (side->max_depth > stage->max_depth) stage->max_depth = side->max_depth;
+    *depth_total += side->depth_total;
+    *pops += side->items;
+}
+
+static void collect_stats(const Pipeline* pipeline, PipelineStats* stats) {
+    memset(stats, 0, sizeof(PipelineStats));
+    stats->parsers = pipeline->lane_count;
+
+    PipelineStageStats* read = &stats->stages[PIPELINE_READ];
+    PipelineStageStats* parse = &stats->stages[PIPELINE_PARSE];
+    PipelineStageStats* encode = &stats->stages[PIPELINE_ENCODE];
+    PipelineStageStats* write = &stats->stages[PIPELINE_WRITE];
+    uint64_t parse_depth = 0, parse_pops = 0;
+    uint64_t encode_depth = 0, encode_pops = 0;
+
+    read->blocks = pipeline->read_blocks;
+    read->bytes = pipeline->read_bytes;
+    for (int i = 0; i < pipeline->lane_count; i++) {
+        const PipelineLane* lane = &pipeline->lanes[i];
+        ring_wait_seconds(&lane->text_free.consumer, &read->output_waits, &read->output_wait_seconds);
+
+        parse->blocks += lane->blocks;
+        parse->bytes += lane->bytes;
+        ring_depth(&lane->text.consumer, parse, &parse_depth, &parse_pops);
+        ring_wait_seconds(&lane->text.consumer, &parse->input_waits, &parse->input_wait_seconds);
+        ring_wait_seconds(&lane->rows_free.consumer, &parse->output_waits, &parse->output_wait_seconds);
+
+        ring_depth(&lane->rows.consumer, encode, &encode_depth, &encode_pops);
+        ring_wait_seconds(&lane->rows.consumer, &encode->input_waits, &encode->input_wait_seconds);
+    }
+    parse->mean_depth = parse_pops ? (double)parse_depth / parse_pops : 0.0;
+
+    encode->blocks = pipeline->encode_blocks;
+    encode->bytes = pipeline->sample_count * pipeline->channel_count * sizeof(float);
+    encode->mean_depth = encode_pops ? (double)encode_depth / encode_pops : 0.0;
+    ring_wait_seconds(&pipeline->columns_free.consumer, &encode->output_waits,
+                      &encode->output_wait_seconds);
+
+    uint64_t write_depth = 0, write_pops = 0;
+    write->blocks = pipeline->write_blocks;
+    write->bytes = pipeline->write_bytes;
+    ring_depth(&pipeline->columns.consumer, write, &write_depth, &write_pops);
+    write->mean_depth = write_pops ? (double)write_depth / write_pops : 0.0;
+    ring_wait_seconds(&pipeline->columns.consumer, &write->input_waits, &write->input_wait_seconds);
+}
+
+// Runs the stages over the data rows, the metadata is already in out_fd
+static void run_pipeline(Pipeline* pipeline) {
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, write_stage, pipeline) != 0) {
+        pipeline_fail(pipeline);
+        return;
+    }
+
+    // Fewer parsers than asked for still works, none doesn't
+    int started = 0;
+    while (started < pipeline->lane_count) {
+        PipelineLane* lane = &pipeline->lanes[started];
+        if (pthread_create(&lane->thread, NULL, parse_stage, lane) != 0) break;
+        started++;
+    }
+    pipeline->lane_count = started;
+
+    pthread_t reader;
+    int reading = started > 0 && pthread_create(&reader, NULL, read_stage, pipeline) == 0;
+    if (!reading) {
+        pipeline_fail(pipeline);
+        for (int i = 0; i < started; i++) spsc_ring_push(&pipeline->lanes[i].text, NULL);
+    }
+
+    if (started > 0) {
+        encode_stage(pipeline);
+    } else {
+        spsc_ring_push(&pipeline->columns, NULL);
+    }
+
+    if (reading) pthread_join(reader, NULL);
+    for (int i = 0; i < started; i++) pthread_join(pipeline->lanes[i].thread, NULL);
+    pthread_join(writer, NULL);
+}
+
+int motec_log_pipeline_csv(MotecLog* log, const char* csv_path, const char* filename,
+                           double frequency, size_t memory_budget, int threads,
+                           PipelineStats* stats) {
+    if (!log || !csv_path || !filename) return -1;
+
+    MappedFile map;
+    if (mapped_file_open(&map, csv_path) != 0) return -1;
+
+    StreamLayout layout;
+    int result = motec_stream_prepare(log, &map, frequency, &layout);
+    mapped_file_close(&map);
+    if (result != 0) return -1;
+
+    Pipeline pipeline;
+    memset(&pipeline, 0, sizeof(Pipeline));
+    pipeline.log = log;
+    pipeline.data_offset = (off_t)layout.data_offset;
+    pipeline.channel_count = layout.channel_count;
+    pipeline.sample_count = layout.sample_count;
+    pipeline.first_timestamp = layout.first_timestamp;
+    pipeline.step = layout.step;
+    atomic_init(&pipeline.failed, 0);
+
+    int parsers = threads - 2;
+    if (parsers < 1) parsers = 1;
+    if (parsers > PIPELINE_MAX_PARSERS) parsers = PIPELINE_MAX_PARSERS;
+
+    // Half the budget goes to sample blocks, text blocks are a fixed size
+    size_t channel_count = layout.channel_count ? layout.channel_count : 1;
+    pipeline.block_size = memory_budget / 2 / (PIPELINE_COLUMN_BLOCKS * channel_count * sizeof(float));
+    if (pipeline.block_size < PIPELINE_MIN_BLOCK_SAMPLES) pipeline.block_size = PIPELINE_MIN_BLOCK_SAMPLES;
+    if (pipeline.block_size > layout.sample_count && layout.sample_count > 0) {
+        pipeline.block_size = layout.sample_count;
+    }
+
+    pipeline.in_fd = open(csv_path, O_RDONLY);
+    FILE* f = fopen(filename, "wb");
+    pipeline.lanes = calloc((size_t)parsers, sizeof(PipelineLane));
+    if (pipeline.in_fd < 0 || !f || !pipeline.lanes ||
+        spsc_ring_init(&pipeline.columns, PIPELINE_COLUMN_BLOCKS + 1) != 0 ||
+        spsc_ring_init(&pipeline.columns_free, PIPELINE_COLUMN_BLOCKS + 1) != 0) {
+        result = -1;
+    }
+
+    for (int b = 0; b < PIPELINE_COLUMN_BLOCKS && result == 0; b++) {
+        pipeline.column_blocks[b].samples = malloc(sizeof(float) * pipeline.block_size * channel_count);
+        if (!pipeline.column_blocks[b].samples) result = -1;
+        else spsc_ring_push(&pipeline.columns_free, &pipeline.column_blocks[b]);
+    }
+    int lanes = 0;
+    while (lanes < parsers && result == 0) {
+        if (init_lane(&pipeline, &pipeline.lanes[lanes++]) != 0) result = -1;
+    }
+    pipeline.lane_count = lanes;
+
+    if (result == 0) result = motec_log_write_metadata(log, f);
+    if (result == 0 && fflush(f) != 0) result = -1;
+
+    if (result == 0) {
+        pipeline.out_fd = fileno(f);
+        run_pipeline(&pipeline);
+        if (atomic_load(&pipeline.failed)) result = -1;
+        if (stats) collect_stats(&pipeline, stats);
+    }
+
+    if (f && fclose(f) != 0) result = -1;
+    if (pipeline.in_fd >= 0) close(pipeline.in_fd);
+    for (int i = 0; i < lanes; i++) free_lane(&pipeline.lanes[i]);
+    free(pipeline.lanes);
+    for (int b = 0; b < PIPELINE_COLUMN_BLOCKS; b++) free(pipeline.column_blocks[b].samples);
+    spsc_ring_destroy(&pipeline.columns);
+    spsc_ring_destroy(&pipeline.columns_free);
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef MOTEC_PIPELINE_H
+#define MOTEC_PIPELINE_H
+
+#include "motec_log.h"
+#include <stdint.h>
+
+typedef enum {
+    PIPELINE_READ,
+    PIPELINE_PARSE,
+    PIPELINE_ENCODE,
+    PIPELINE_WRITE,
+    PIPELINE_STAGE_COUNT
+} PipelineStage;
+
+// What one stage did and how long it spent waiting on its neighbours. Input
+// waits mean the stage ran dry, output waits mean the stage after it was
+// full and pushed back. Depth is of the queue feeding the stage.
+typedef struct {
+    uint64_t blocks;
+    uint64_t bytes;
+    size_t max_depth;
+    double mean_depth;
+    uint64_t input_waits;
+    double input_wait_seconds;
+    uint64_t output_waits;
+    double output_wait_seconds;
+} PipelineStageStats;
+
+typedef struct {
+    PipelineStageStats stages[PIPELINE_STAGE_COUNT];
+    int parsers;
+} PipelineStats;
+
+// Same conversion as motec_log_stream_csv with the second pass split into
+// stages that run at once: a reader thread cuts the file into line aligned
+// blocks, parser threads turn blocks into rows, the calling thread holds
+// and resamples values into per channel sample blocks and a writer thread
+// puts those in place. Stages hand blocks over through single producer,
+// single consumer rings and get them back through a second ring, so the
+// fixed number of blocks in flight is what bounds memory and makes a fast
+// stage wait for a slow one.
+//
+// threads is the total to use, parsers get what's left after the reader,
+// the writer and the caller but there is always at least one. stats may be
+// NULL.
+int motec_log_pipeline_csv(MotecLog* log, const char* csv_path, const char* filename,
+                           double frequency, size_t memory_budget, int threads,
+                           PipelineStats* stats);
+
+const char* pipeline_stage_name(PipelineStage stage);
+
+#endif
@@ -0,0 +1,236 @@
+#include "motec_stream.h"
+#include "csv_parser.h"
+#include "mapped_file.h"
+
+#define STREAM_MIN_BLOCK_SAMPLES 1024
+#define STREAM_RELEASE_INTERVAL (16 << 20)
+
+// Result of the first pass over the data rows
+typedef struct {
+    size_t rows;
+    double first_timestamp;
+    double last_timestamp;
+} CsvScan;
+
+// Per channel sample blocks, flushed to each channel's data offset when full
+typedef struct {
+    FILE* f;
+    MotecLog* log;
+    size_t channel_count;
+    float* block;          // channel_count blocks of block_size samples
+    size_t block_size;
+    size_t block_fill;
+    size_t written;        // Samples already flushed per channel
+    size_t sample_count;   // Samples every channel ends up with
+    double* held;          // Latest value per channel
+} StreamWriter;
+
+static void scan_csv_rows(MappedFile* map, const char* p, CsvScan* scan) {
+    const char* end = map->data + map->size;
+    const char* released = p;
+    scan->rows = 0;
+    scan->first_timestamp = 0.0;
+    scan->last_timestamp = 0.0;
+
+    while (p < end) {
+        CsvField field;
+        double timestamp;
+        p = csv_first_field(p, end, &field);
+        if (!csv_parse_number(field.start, field.len, &timestamp, NULL)) continue;
+
+        if (scan->rows == 0) scan->first_timestamp = timestamp;
+        scan->last_timestamp = timestamp;
+        scan->rows++;
+
+        if (p - released >= STREAM_RELEASE_INTERVAL) {
+            mapped_file_release(map, p);
+            released = p;
+        }
+    }
+}
+
+// Same result as channel_avg_frequency on the channel the DataLog path builds
+static int stream_frequency(size_t count, double start, double end) {
+    if (count < 2) return 0;
+    double duration = end - start;
+    if (duration <= 0.0) return 0;
+    return (int)((count - 1) / duration);
+}
+
+static int stream_flush(StreamWriter* writer) {
+    if (writer->block_fill == 0) return 0;
+
+    for (size_t i = 0; i < writer->channel_count; i++) {
+        LDChannel* chan = writer->log->ld_channels[i];
+        long offset = chan->data_ptr + (long)(writer->written * sizeof(float));
+        if (fseek(writer->f, offset, SEEK_SET) != 0) return -1;
+        if (fwrite(writer->block + i * writer->block_size, sizeof(float),
+                   writer->block_fill, writer->f) != writer->block_fill) return -1;
+    }
+
+    writer->written += writer->block_fill;
+    writer->block_fill = 0;
+    return 0;
+}
+
+// Appends the held values as the next sample of every channel
+static int stream_emit(StreamWriter* writer) {
+    if (writer->written + writer->block_fill >= writer->sample_count) return 0;
+
+    for (size_t i = 0; i < writer->channel_count; i++) {
+        writer->block[i * writer->block_size + writer->block_fill] = (float)writer->held[i];
+    }
+    writer->block_fill++;
+
+    if (writer->block_fill == writer->block_size) return stream_flush(writer);
+    return 0;
+}
+
+// Updates the held values from a row, missing cells keep the previous value
+static void stream_hold_row(StreamWriter* writer, const CsvRow* row) {
+    for (size_t i = 0; i < writer->channel_count && i + 1 < row->count; i++) {
+        const CsvField* field = &row->fields[i + 1];
+        double value;
+        if (csv_parse_number(field->start, field->len, &value, NULL)) {
+            writer->held[i] = value;
+        }
+    }
+}
+
+static char* field_copy(const CsvField* field, char* buffer, size_t size) {
+    size_t len = field->len < size - 1 ? field->len : size - 1;
+    memcpy(buffer, field->start, len);
+    buffer[len] = '\0';
+    return buffer;
+}
+
+int motec_stream_prepare(MotecLog* log, MappedFile* map, double frequency, StreamLayout* layout) {
+    const char* p = map->data;
+    const char* end = map->data + map->size;
+    memset(layout, 0, sizeof(StreamLayout));
+
+    CsvRow header;
+    CsvRow units;
+    csv_row_init(&header);
+    csv_row_init(&units);
+
+    // Header and units lines, the first column is time
+    p = csv_split_row(p, end, &header);
+    p = csv_split_row(p, end, &units);
+    size_t channel_count = header.count < units.count ? header.count : units.count;
+    channel_count = channel_count > 0 ? channel_count - 1 : 0;
+    layout->data_offset = (size_t)(p - map->data);
+    layout->channel_count = channel_count;
+
+    // First pass fixes the number of samples and so every data offset
+    CsvScan scan;
+    scan_csv_rows(map, p, &scan);
+
+    layout->sample_count = scan.rows;
+    layout->first_timestamp = scan.first_timestamp;
+    int freq = stream_frequency(scan.rows, scan.first_timestamp, scan.last_timestamp);
+    if (frequency > 0.0) {
+        double samples = floor(frequency * (scan.last_timestamp - scan.first_timestamp));
+        layout->sample_count = samples > 0 ? (size_t)samples : 0;
+        layout->step = 1.0 / frequency;
+        freq = stream_frequency(layout->sample_count, scan.first_timestamp,
+            scan.first_timestamp + (double)(layout->sample_count - 1) * layout->step);
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < channel_count; i++) {
+        char name[64];
+        char unit[64];
+        if (!motec_log_append_channel(log,
+                field_copy(&header.fields[i + 1], name, sizeof(name)),
+                field_copy(&units.fields[i + 1], unit, sizeof(unit)),
+                freq, (int)layout->sample_count)) {
+            result = -1;
+            break;
+        }
+    }
+    csv_row_free(&header);
+    csv_row_free(&units);
+    return result;
+}
+
+int motec_log_stream_csv(MotecLog* log, const char* csv_path, const char* filename,
+                         double frequency, size_t memory_budget) {
+    if (!log || !csv_path || !filename) return -1;
+
+    MappedFile map;
+    if (mapped_file_open(&map, csv_path) != 0) return -1;
+
+    StreamLayout layout;
+    int result = motec_stream_prepare(log, &map, frequency, &layout);
+    size_t channel_count = layout.channel_count;
+    size_t sample_count = layout.sample_count;
+    double step = layout.step;
+    const char* p = map.data + layout.data_offset;
+    const char* end = map.data + map.size;
+
+    CsvRow row;
+    csv_row_init(&row);
+
+    // As many samples per block as the budget allows for every channel
+    StreamWriter writer;
+    memset(&writer, 0, sizeof(StreamWriter));
+    writer.log = log;
+    writer.channel_count = channel_count;
+    writer.sample_count = sample_count;
+    writer.block_size = channel_count ? memory_budget / (channel_count * sizeof(float)) : 1;
+    if (writer.block_size < STREAM_MIN_BLOCK_SAMPLES) writer.block_size = STREAM_MIN_BLOCK_SAMPLES;
+    if (writer.block_size > sample_count && sample_count > 0) writer.block_size = sample_count;
+
+    if (result == 0) {
+        writer.block = malloc(sizeof(float) * writer.block_size * (channel_count ? channel_count : 1));
+        writer.held = calloc(channel_count ? channel_count : 1, sizeof(double));
+        writer.f = fopen(filename, "wb");
+        if (!writer.block || !writer.held || !writer.f) result = -1;
+    }
+
+    if (result == 0) result = motec_log_write_metadata(log, writer.f);
+
+    // Second pass, rows go straight into the blocks
+    size_t grid_index = 0;
+    const char* released = map.data;
+    while (result == 0 && p < end) {
+        p = csv_split_row(p, end, &row);
+
+        double timestamp;
+        CsvField* time_field = &row.fields[0];
+        if (!csv_parse_number(time_field->start, time_field->len, &timestamp, NULL)) continue;
+
+        if (frequency > 0.0) {
+            // Grid points whose window closed before this row take the
+            // values held so far, then the row updates them
+            while (result == 0 && grid_index < sample_count &&
+                   timestamp >= layout.first_timestamp + (double)grid_index * step + 0.5 * step) {
+                result = stream_emit(&writer);
+                grid_index++;
+            }
+            stream_hold_row(&writer, &row);
+        } else {
+            stream_hold_row(&writer, &row);
+            result = stream_emit(&writer);
+        }
+
+        if (p - released >= STREAM_RELEASE_INTERVAL) {
+            mapped_file_release(&map, p);
+            released = p;
+        }
+    }
+
+    // Whatever is left of the grid holds the last values
+    while (result == 0 && writer.written + writer.block_fill < sample_count) {
+        result = stream_emit(&writer);
+    }
+    if (result == 0) result = stream_flush(&writer);
+
+    if (writer.f && fclose(writer.f) != 0) result = -1;
+    free(writer.block);
+    free(writer.held);
+    csv_row_free(&row);
+    mapped_file_close(&map);
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef MOTEC_STREAM_H
+#define MOTEC_STREAM_H
+
+#include "motec_log.h"
+#include "mapped_file.h"
+
+#define DEFAULT_MEMORY_BUDGET (64 << 20)
+
+// Shape of a CSV log as fixed by the first pass over it
+typedef struct {
+    size_t data_offset;       // Start of the data rows in the file
+    size_t channel_count;
+    size_t sample_count;      // Samples every channel ends up with
+    double first_timestamp;
+    double step;              // Resampling grid spacing, 0 keeps every row
+} StreamLayout;
+
+// Reads the header and units lines, counts the data rows and appends a
+// channel per column to log. Shared by the streaming converters, which
+// then only have to fill in the samples.
+int motec_stream_prepare(MotecLog* log, MappedFile* map, double frequency, StreamLayout* layout);
+
+// Converts a CSV log straight to a .ld file without building a DataLog.
+// A first pass over the mapped input counts the data rows so every channel's
+// data offset is known up front, the second pass parses rows into small per
+// channel blocks that are written to their final place as they fill up.
+// Sample memory stays within memory_budget bytes however big the input is.
+// A frequency above 0 resamples on the fly exactly like datalog_resample.
+int motec_log_stream_csv(MotecLog* log, const char* csv_path, const char* filename,
+                         double frequency, size_t memory_budget);
+
+#endif
@@ -0,0 +1,95 @@
+#include "name_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_INDEX_CAPACITY 64
+
+// FNV-1a, names are short so a simple byte loop is plenty
+static uint64_t hash_name(const char* key, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void name_index_init(NameIndex* index) {
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+void name_index_free(NameIndex* index) {
+    free(index->slots);
+    name_index_init(index);
+}
+
+void name_index_clear(NameIndex* index) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        index->slots[i].value = -1;
+    }
+    index->count = 0;
+}
+
+// Slot holding the key, or the empty slot it would go in
+static NameIndexSlot* probe(const NameIndex* index, const char* key, size_t len, uint64_t hash) {
+    size_t mask = index->capacity - 1;
+    size_t i = (size_t)hash & mask;
+
+    while (1) {
+        NameIndexSlot* slot = &index->slots[i];
+        if (slot->value < 0) return slot;
+        if (slot->hash == hash && slot->len == len && memcmp(slot->key, key, len) == 0) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static int grow(NameIndex* index) {
+    size_t new_capacity = index->capacity ? index->capacity * 2 : INITIAL_INDEX_CAPACITY;
+    NameIndexSlot* new_slots = malloc(sizeof(NameIndexSlot) * new_capacity);
+    if (!new_slots) return -1;
+    for (size_t i = 0; i < new_capacity; i++) {
+        new_slots[i].value = -1;
+    }
+
+    NameIndex grown = { new_slots, new_capacity, index->count };
+    for (size_t i = 0; i < index->capacity; i++) {
+        NameIndexSlot* slot = &index->slots[i];
+        if (slot->value < 0) continue;
+        *probe(&grown, slot->key, slot->len, slot->hash) = *slot;
+    }
+
+    free(index->slots);
+    *index = grown;
+    return 0;
+}
+
+int name_index_insert(NameIndex* index, const char* key, int value) {
+    if (!key || value < 0) return -1;
+    if ((index->count + 1) * 2 > index->capacity && grow(index) != 0) return -1;
+
+    size_t len = strlen(key);
+    uint64_t hash = hash_name(key, len);
+    NameIndexSlot* slot = probe(index, key, len, hash);
+    if (slot->value >= 0) return 0;
+
+    slot->key = key;
+    slot->len = len;
+    slot->hash = hash;
+    slot->value = value;
+    index->count++;
+    return 0;
+}
+
+int name_index_find_n(const NameIndex* index, const char* key, size_t len) {
+    if (index->count == 0 || !key) return -1;
+    return probe(index, key, len, hash_name(key, len))->value;
+}
+
+int name_index_find(const NameIndex* index, const char* key) {
+    if (!key) return -1;
+    return name_index_find_n(index, key, strlen(key));
+}
@@ -0,0 +1,33 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char* key;
+    size_t len;
+    uint64_t hash;
+    int value;          // -1 marks an empty slot
+} NameIndexSlot;
+
+// Open addressing hash table from names to indices, linear probing and at
+// most half full. Keys are not copied, they have to outlive the index. When
+// a name is inserted twice the first index is kept, matching what a linear
+// scan for the name would find.
+typedef struct {
+    NameIndexSlot* slots;
+    size_t capacity;    // Power of two, 0 before the first insert
+    size_t count;
+} NameIndex;
+
+void name_index_init(NameIndex* index);
+void name_index_free(NameIndex* index);
+void name_index_clear(NameIndex* index);
+int name_index_insert(NameIndex* index, const char* key, int value);
+
+// Index stored for the name or -1, key doesn't need to be NUL terminated
+int name_index_find_n(const NameIndex* index, const char* key, size_t len);
+int name_index_find(const NameIndex* index, const char* key);
+
+#endif
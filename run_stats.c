@@ -0,0 +1,138 @@
+#include "run_stats.h"
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+static const char* STAGE_NAMES[RUN_STAGE_COUNT] = {
+    "load", "parse", "resample", "build", "write", "stream", "batch"
+};
+
+const char* run_stage_name(RunStage stage) {
+    return stage < RUN_STAGE_COUNT ? STAGE_NAMES[stage] : "";
+}
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// ru_maxrss is in kilobytes on Linux and in bytes on macOS
+uint64_t run_stats_peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+void run_stats_init(RunStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(RunStats));
+    stats->start_wall = clock_seconds(CLOCK_MONOTONIC);
+    stats->start_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void run_stats_begin(const RunStats* stats, RunStatsMark* mark, const Arena* arena) {
+    if (!stats) return;
+    mark->wall = clock_seconds(CLOCK_MONOTONIC);
+    mark->cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    mark->allocations = arena ? arena->allocations : 0;
+}
+
+void run_stats_end(RunStats* stats, RunStage stage, const RunStatsMark* mark, const Arena* arena,
+                   uint64_t bytes, uint64_t rows) {
+    if (!stats || stage >= RUN_STAGE_COUNT) return;
+
+    RunStageStats* s = &stats->stages[stage];
+    s->ran = 1;
+    s->wall_seconds += clock_seconds(CLOCK_MONOTONIC) - mark->wall;
+    s->cpu_seconds += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - mark->cpu;
+    s->bytes += bytes;
+    if (rows > s->rows) s->rows = rows;
+    if (arena && arena->allocations >= mark->allocations) {
+        s->allocations += arena->allocations - mark->allocations;
+    }
+    s->peak_rss = run_stats_peak_rss();
+}
+
+void run_stats_set_pipeline(RunStats* stats, const PipelineStats* pipeline) {
+    if (!stats || !pipeline) return;
+    stats->has_pipeline = 1;
+    stats->pipeline = *pipeline;
+}
+
+static void write_json_string(FILE* f, const char* str) {
+    fputc('"', f);
+    for (const unsigned char* p = (const unsigned char*)(str ? str : ""); *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void write_pipeline(FILE* f, const PipelineStats* pipeline) {
+    fprintf(f, ",\n  \"pipeline\": {\n    \"parsers\": %d,\n    \"stages\": [", pipeline->parsers);
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        const PipelineStageStats* stage = &pipeline->stages[i];
+        fprintf(f, "%s\n      {\"name\": \"%s\", \"blocks\": %llu, \"bytes\": %llu, "
+                "\"max_queue_depth\": %zu, \"mean_queue_depth\": %.3f, "
+                "\"input_waits\": %llu, \"input_wait_seconds\": %.6f, "
+                "\"output_waits\": %llu, \"output_wait_seconds\": %.6f}",
+                i ? "," : "", pipeline_stage_name((PipelineStage)i),
+                (unsigned long long)stage->blocks, (unsigned long long)stage->bytes,
+                stage->max_depth, stage->mean_depth,
+                (unsigned long long)stage->input_waits, stage->input_wait_seconds,
+                (unsigned long long)stage->output_waits, stage->output_wait_seconds);
+    }
+    fprintf(f, "\n    ]\n  }");
+}
+
+int run_stats_write_json(const RunStats* stats, const char* path, const char* input,
+                         const char* output, const char* log_type, int result) {
+    if (!stats || !path) return -1;
+
+    FILE* f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "{\n  \"input\": ");
+    write_json_string(f, input);
+    fprintf(f, ",\n  \"output\": ");
+    write_json_string(f, output);
+    fprintf(f, ",\n  \"log_type\": ");
+    write_json_string(f, log_type);
+    fprintf(f, ",\n  \"status\": \"%s\",\n", result == 0 ? "ok" : "failed");
+    fprintf(f, "  \"wall_seconds\": %.6f,\n  \"cpu_seconds\": %.6f,\n  \"peak_rss_bytes\": %llu,\n",
+            clock_seconds(CLOCK_MONOTONIC) - stats->start_wall,
+            clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - stats->start_cpu,
+            (unsigned long long)run_stats_peak_rss());
+
+    // Stages in the order they run, ones that didn't run are left out
+    fprintf(f, "  \"stages\": [");
+    int first = 1;
+    for (int i = 0; i < RUN_STAGE_COUNT; i++) {
+        const RunStageStats* stage = &stats->stages[i];
+        if (!stage->ran) continue;
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, "
+                "\"bytes\": %llu, \"rows\": %llu, \"allocations\": %llu, \"peak_rss_bytes\": %llu}",
+                first ? "" : ",", run_stage_name((RunStage)i),
+                stage->wall_seconds, stage->cpu_seconds,
+                (unsigned long long)stage->bytes, (unsigned long long)stage->rows,
+                (unsigned long long)stage->allocations, (unsigned long long)stage->peak_rss);
+        first = 0;
+    }
+    fprintf(f, "\n  ]");
+
+    if (stats->has_pipeline) write_pipeline(f, &stats->pipeline);
+    fprintf(f, "\n}\n");
+
+    if (f == stdout) return fflush(f) == 0 ? 0 : -1;
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,64 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "arena.h"
+#include "motec_pipeline.h"
+
+typedef enum {
+    RUN_STAGE_LOAD,
+    RUN_STAGE_PARSE,
+    RUN_STAGE_RESAMPLE,
+    RUN_STAGE_BUILD,        // MotecLog channels from the DataLog
+    RUN_STAGE_WRITE,
+    RUN_STAGE_STREAM,       // --stream and --pipeline do it all in one go
+    RUN_STAGE_BATCH,        // Rows are the logs converted
+    RUN_STAGE_COUNT
+} RunStage;
+
+// What one stage of a conversion cost. CPU time is the whole process's, so
+// it includes the pool threads working for the stage. Bytes are what the
+// stage read or produced, rows how many samples the longest channel had
+// once it was done. Allocations are the requests the DataLog's arena
+// served. Peak RSS is the high water mark at the end of the stage.
+typedef struct {
+    int ran;
+    double wall_seconds;
+    double cpu_seconds;
+    uint64_t bytes;
+    uint64_t rows;
+    uint64_t allocations;
+    uint64_t peak_rss;
+} RunStageStats;
+
+typedef struct {
+    RunStageStats stages[RUN_STAGE_COUNT];
+    double start_wall;
+    double start_cpu;
+    int has_pipeline;
+    PipelineStats pipeline;
+} RunStats;
+
+// Taken when a stage starts
+typedef struct {
+    double wall;
+    double cpu;
+    uint64_t allocations;
+} RunStatsMark;
+
+// All of these do nothing when stats is NULL, and arena may be NULL
+void run_stats_init(RunStats* stats);
+void run_stats_begin(const RunStats* stats, RunStatsMark* mark, const Arena* arena);
+void run_stats_end(RunStats* stats, RunStage stage, const RunStatsMark* mark, const Arena* arena,
+                   uint64_t bytes, uint64_t rows);
+void run_stats_set_pipeline(RunStats* stats, const PipelineStats* pipeline);
+
+const char* run_stage_name(RunStage stage);
+uint64_t run_stats_peak_rss(void);
+
+// Writes the stats as one JSON object, path "-" is stdout
+int run_stats_write_json(const RunStats* stats, const char* path, const char* input,
+                         const char* output, const char* log_type, int result);
+
+#endif
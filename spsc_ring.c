@@ -0,0 +1,108 @@
+#include "spsc_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#define RING_SPINS 128
+#define RING_YIELDS 64
+#define RING_SLEEP_NS 50000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Short waits are usually over within a few spins, long ones (a stage stuck
+// on I/O) shouldn't burn a core
+static void backoff(unsigned* attempt) {
+    if (*attempt < RING_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (*attempt < RING_SPINS + RING_YIELDS) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, RING_SLEEP_NS};
+        nanosleep(&ts, NULL);
+    }
+    (*attempt)++;
+}
+
+int spsc_ring_init(SpscRing* ring, size_t capacity) {
+    if (!ring) return -1;
+    memset(ring, 0, sizeof(SpscRing));
+
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    ring->slots = calloc(size, sizeof(void*));
+    if (!ring->slots) return -1;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+void spsc_ring_destroy(SpscRing* ring) {
+    if (!ring) return;
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+int spsc_ring_try_push(SpscRing* ring, void* item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask) return 0;
+    }
+
+    ring->slots[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    ring->producer.items++;
+    return 1;
+}
+
+int spsc_ring_try_pop(SpscRing* ring, void** item) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->cached_tail) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == ring->cached_tail) return 0;
+    }
+
+    size_t depth = ring->cached_tail - head;
+    if (depth > ring->consumer.max_depth) ring->consumer.max_depth = depth;
+    ring->consumer.depth_total += depth;
+
+    *item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    ring->consumer.items++;
+    return 1;
+}
+
+void spsc_ring_push(SpscRing* ring, void* item) {
+    if (spsc_ring_try_push(ring, item)) return;
+
+    uint64_t start = now_ns();
+    unsigned attempt = 0;
+    do {
+        backoff(&attempt);
+    } while (!spsc_ring_try_push(ring, item));
+    ring->producer.waits++;
+    ring->producer.wait_ns += now_ns() - start;
+}
+
+void* spsc_ring_pop(SpscRing* ring) {
+    void* item;
+    if (spsc_ring_try_pop(ring, &item)) return item;
+
+    uint64_t start = now_ns();
+    unsigned attempt = 0;
+    do {
+        backoff(&attempt);
+    } while (!spsc_ring_try_pop(ring, &item));
+    ring->consumer.waits++;
+    ring->consumer.wait_ns += now_ns() - start;
+    return item;
+}
@@ -0,0 +1,45 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SPSC_CACHE_LINE 64
+
+// Counters kept by each side of a ring. A wait is one episode of finding the
+// ring full (producer) or empty (consumer); wait_ns is the time spent in them.
+typedef struct {
+    uint64_t items;
+    uint64_t waits;
+    uint64_t wait_ns;
+    size_t max_depth;      // Consumer only, items queued when popping
+    uint64_t depth_total;  // Consumer only, for the mean depth
+} SpscRingSide;
+
+// Bounded lock-free queue of pointers between exactly one producer thread and
+// one consumer thread. Head and tail sit on their own cache lines so the two
+// sides only share a line when one actually looks at the other's index. A
+// full ring is backpressure: the blocking push waits until the consumer makes
+// room, spinning briefly before it yields and then sleeps.
+typedef struct {
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;   // Next slot to pop
+    size_t cached_tail;
+    SpscRingSide consumer;
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;   // Next slot to push
+    size_t cached_head;
+    SpscRingSide producer;
+    _Alignas(SPSC_CACHE_LINE) void** slots;
+    size_t mask;
+} SpscRing;
+
+// Capacity is rounded up to a power of two
+int spsc_ring_init(SpscRing* ring, size_t capacity);
+void spsc_ring_destroy(SpscRing* ring);
+
+int spsc_ring_try_push(SpscRing* ring, void* item);
+int spsc_ring_try_pop(SpscRing* ring, void** item);
+void spsc_ring_push(SpscRing* ring, void* item);
+void* spsc_ring_pop(SpscRing* ring);
+
+#endif
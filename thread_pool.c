@@ -0,0 +1,186 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// One parallel loop, lives on the stack of the thread that started it
+typedef struct PoolJob {
+    ThreadPoolTask task;
+    void* ctx;
+    size_t count;
+    atomic_size_t next;
+    int workers;           // Workers currently inside the loop, guarded by the pool lock
+    pthread_cond_t finished;
+    struct PoolJob* next_job;
+} PoolJob;
+
+struct ThreadPool {
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    PoolJob* jobs;
+    int shutdown;
+};
+
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool* default_pool = NULL;
+static int default_threads = 0;
+
+// Claims and runs indices until the loop is exhausted
+static void run_job(PoolJob* job) {
+    for (;;) {
+        size_t index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->count) break;
+
+        job->task(job->ctx, index);
+    }
+}
+
+static PoolJob* find_open_job(ThreadPool* pool) {
+    for (PoolJob* job = pool->jobs; job; job = job->next_job) {
+        if (atomic_load(&job->next) < job->count) return job;
+    }
+    return NULL;
+}
+
+static void* worker_main(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        PoolJob* job;
+        while (!pool->shutdown && !(job = find_open_job(pool))) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) break;
+
+        job->workers++;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&pool->lock);
+        job->workers--;
+        if (job->workers == 0) pthread_cond_signal(&job->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static int online_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+ThreadPool* thread_pool_create(int threads) {
+    if (threads <= 0) threads = online_cpus();
+
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    pool->thread_count = 0;
+    pool->jobs = NULL;
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+
+    // The caller of each loop is the remaining thread
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) break;
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+int thread_pool_size(ThreadPool* pool) {
+    return pool ? pool->thread_count + 1 : 1;
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, size_t count, ThreadPoolTask task, void* ctx) {
+    if (count == 0) return;
+
+    // Nothing to share, run inline
+    if (!pool || pool->thread_count == 0 || count == 1) {
+        for (size_t i = 0; i < count; i++) task(ctx, i);
+        return;
+    }
+
+    PoolJob job;
+    job.task = task;
+    job.ctx = ctx;
+    job.count = count;
+    atomic_init(&job.next, 0);
+    job.workers = 0;
+    pthread_cond_init(&job.finished, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    job.next_job = pool->jobs;
+    pool->jobs = &job;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_job(&job);
+
+    // Unlink so no new worker picks it up, then wait for the ones inside
+    pthread_mutex_lock(&pool->lock);
+    PoolJob** link = &pool->jobs;
+    while (*link != &job) link = &(*link)->next_job;
+    *link = job.next_job;
+
+    while (job.workers > 0) {
+        pthread_cond_wait(&job.finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_cond_destroy(&job.finished);
+}
+
+void thread_pool_set_default_threads(int threads) {
+    pthread_mutex_lock(&default_lock);
+    default_threads = threads;
+    pthread_mutex_unlock(&default_lock);
+}
+
+ThreadPool* thread_pool_default(void) {
+    pthread_mutex_lock(&default_lock);
+    if (!default_pool) {
+        default_pool = thread_pool_create(default_threads);
+    }
+    ThreadPool* pool = default_pool;
+    pthread_mutex_unlock(&default_lock);
+    return pool;
+}
+
+void thread_pool_shutdown_default(void) {
+    pthread_mutex_lock(&default_lock);
+    thread_pool_destroy(default_pool);
+    default_pool = NULL;
+    pthread_mutex_unlock(&default_lock);
+}
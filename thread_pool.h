@@ -0,0 +1,26 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// Runs task(ctx, index) once for every index in [0, count)
+typedef void (*ThreadPoolTask)(void* ctx, size_t index);
+
+typedef struct ThreadPool ThreadPool;
+
+// A pool of n threads has n-1 workers, the thread calling
+// thread_pool_parallel_for always works on its own loop as well. That also
+// makes nested parallel loops safe, a worker waiting on an inner loop keeps
+// running indices of it instead of blocking.
+ThreadPool* thread_pool_create(int threads);
+void thread_pool_destroy(ThreadPool* pool);
+int thread_pool_size(ThreadPool* pool);
+void thread_pool_parallel_for(ThreadPool* pool, size_t count, ThreadPoolTask task, void* ctx);
+
+// Process wide pool used by the parsers and writers, sized from the command
+// line. A thread count of 0 means one thread per online CPU.
+void thread_pool_set_default_threads(int threads);
+ThreadPool* thread_pool_default(void);
+void thread_pool_shutdown_default(void);
+
+#endif